@@ -96,7 +96,9 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    // committed blocks not yet checkpointed live in the log.
+    if(log_read(b) == 0)
+      virtio_disk_rw(b, 0);
     b->valid = 1;
   }
   return b;
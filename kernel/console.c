@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -53,6 +54,14 @@ struct {
 
   //permitir la consola en crudo y no linea a linea para el editor de texto 
   int raw_mode;
+
+  //en modo crudo, como VMIN y VTIME de termios: read espera a tener
+  //vmin bytes, pero no mas de vtime ticks desde el ultimo que llego
+  //(o desde la llamada, si vmin es 0)
+  int vmin;
+  int vtime;
+  int readers;      //procesos dormidos en consolereadraw
+  int npoll;        //poll() registrados en la consola
 } cons;
 
 //
@@ -61,18 +70,93 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m;
+
+  // copy in chunks that stop at user page boundaries, so that a
+  // bad address still lets the bytes before it through.
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(user_src && m > PGSIZE - (src + i) % PGSIZE)
+      m = PGSIZE - (src + i) % PGSIZE;
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
 
   return i;
 }
 
+//
+// raw mode read: wait as cons.vmin and cons.vtime say, then
+// hand over everything there is (up to n) in as few copies
+// as the ring and dst's pages allow. ^D is just another byte.
+// called with cons.lock held; releases it.
+//
+static int
+consolereadraw(int user_dst, uint64 dst, int n)
+{
+  uint want, have, deadline;
+  int got, m, r;
+
+  if(cons.vmin > 0)
+    want = cons.vmin < n ? cons.vmin : n;
+  else
+    want = cons.vtime > 0 ? 1 : 0;
+  have = cons.w - cons.r;
+  deadline = ticks + cons.vtime;
+  while(cons.w - cons.r < want){
+    if(killed(myproc())){
+      release(&cons.lock);
+      return -1;
+    }
+    cons.readers++;
+    if(cons.vtime == 0 || (cons.vmin > 0 && cons.w == cons.r)){
+      sleep(&cons.r, &cons.lock);
+      r = 0;
+    } else {
+      if(cons.vmin > 0 && cons.w - cons.r != have){
+        // a byte arrived: the timer starts over.
+        have = cons.w - cons.r;
+        deadline = ticks + cons.vtime;
+      }
+      r = sleepuntil(&cons.r, &cons.lock, deadline);
+    }
+    cons.readers--;
+    if(r < 0)
+      break;
+  }
+
+  for(got = 0; got < n && cons.r != cons.w; got += m){
+    m = n - got;
+    if(m > cons.w - cons.r)
+      m = cons.w - cons.r;
+    if(m > INPUT_BUF_SIZE - cons.r % INPUT_BUF_SIZE)
+      m = INPUT_BUF_SIZE - cons.r % INPUT_BUF_SIZE;
+    if(user_dst && m > PGSIZE - (dst + got) % PGSIZE)
+      m = PGSIZE - (dst + got) % PGSIZE;
+    if(either_copyout(user_dst, dst + got, &cons.buf[cons.r % INPUT_BUF_SIZE], m) == -1){
+      // if dst is a page exec() has not loaded yet, bring it
+      // in without the lock and retry.
+      if(!user_dst)
+        break;
+      release(&cons.lock);
+      r = vmfault(myproc(), dst + got, 1);
+      acquire(&cons.lock);
+      if(r < 0)
+        break;
+      m = 0;
+      continue;
+    }
+    cons.r += m;
+  }
+  release(&cons.lock);
+
+  return got;
+}
+
 //
 // user read()s from the console go here.
 // copy (up to) a whole input line to dst.
@@ -83,11 +167,13 @@ int
 consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
+  int c, r;
   char cbuf;
 
   target = n;
   acquire(&cons.lock);
+  if(cons.raw_mode)
+    return consolereadraw(user_dst, dst, n);
   while(n > 0){
     // wait until interrupt handler has put some
     // input into cons.buffer.
@@ -96,7 +182,9 @@ consoleread(int user_dst, uint64 dst, int n)
         release(&cons.lock);
         return -1;
       }
+      cons.readers++;
       sleep(&cons.r, &cons.lock);
+      cons.readers--;
     }
 
     c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
@@ -112,8 +200,19 @@ consoleread(int user_dst, uint64 dst, int n)
 
     // copy the input byte to the user-space buffer.
     cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
+    if(either_copyout(user_dst, dst, &cbuf, 1) == -1){
+      // leave c for later; if dst is a page exec() has not
+      // loaded yet, bring it in without the lock and retry.
+      cons.r--;
+      if(!user_dst)
+        break;
+      release(&cons.lock);
+      r = vmfault(myproc(), dst, 1);
+      acquire(&cons.lock);
+      if(r < 0)
+        break;
+      continue;
+    }
 
     dst++;
     --n;
@@ -147,7 +246,10 @@ consoleintr(int c)
       cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
 
       cons.w = cons.e;
-      wakeup(&cons.r);
+      if(cons.readers)
+        wakeup(&cons.r);
+      if(cons.npoll)
+        pollwakeup();
     }
 
     release(&cons.lock);
@@ -187,6 +289,8 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        if(cons.npoll)
+          pollwakeup();
       }
     }
     break;
@@ -204,6 +308,8 @@ consoleinit(void)
 
   //poner la consola en modo no raw por defecto 
   cons.raw_mode = 0;
+  cons.vmin = 1;
+  cons.vtime = 0;
 
   // connect read and write system calls
   // to consoleread and consolewrite.
@@ -223,6 +329,10 @@ console_set_raw(int enabled)
   //caracteres de una línea anterior
   cons.r = cons.w = cons.e = 0;
 
+  //y cada programa empieza con las lecturas bloqueantes de siempre
+  cons.vmin = 1;
+  cons.vtime = 0;
+
   release(&cons.lock);
 }
 
@@ -240,3 +350,35 @@ console_available(void)
 
   return n;
 }
+
+//fija vmin y vtime (en ticks) para las lecturas en modo crudo
+int
+console_set_timeout(int vmin, int vtime)
+{
+  if(vmin < 0 || vmin > INPUT_BUF_SIZE || vtime < 0)
+    return -1;
+
+  acquire(&cons.lock);
+  cons.vmin = vmin;
+  cons.vtime = vtime;
+  release(&cons.lock);
+
+  return 0;
+}
+
+//lo que poll() encontraria en la consola: se puede leer si hay
+//entrada lista (una linea entera, o cualquier byte en modo crudo)
+//y escribir siempre. reg registra (1) o quita (-1) un poll
+int
+consolepoll(int reg)
+{
+  int ev = POLLOUT;
+
+  acquire(&cons.lock);
+  cons.npoll += reg;
+  if(cons.w != cons.r)
+    ev |= POLLIN;
+  release(&cons.lock);
+
+  return ev;
+}
@@ -3,10 +3,15 @@ struct context;
 struct file;
 struct inode;
 struct pipe;
+struct pollfd;
+struct vdso;
+struct ucursor;
+struct iovec;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct fsstat;
 struct superblock;
 
 // bio.c
@@ -23,9 +28,12 @@ void            consoleintr(int);
 void            consputc(int);
 void            console_set_raw(int);
 int             console_available(void);
+int             console_set_timeout(int, int);
+int             consolepoll(int);
 
 // exec.c
 int             exec(char*, char**);
+int             kexec(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -35,13 +43,20 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
+int             filewritev(struct file*, struct iovec*, int, int);
+int             filepoll(struct file*, int);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            fsstat(struct fsstat*);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            iexec(struct inode*, int);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -70,23 +85,52 @@ void            kinit(void);
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
+int             begin_opw(int, int);
+int             log_read(struct buf*);
 void            end_op(void);
+void            log_force(void);
+int             log_setmode(int);
+int             log_bypass(uint);
+int             log_grow(uint);
+int             log_ordered(void);
+
+// poll.c
+void            pollinit(void);
+void            pollwakeup(void);
+int             poll(struct pollfd*, int, int);
+
+// uring.c
+uint64          ring_setup(void);
+int             ring_enter(void);
+
+// pcache.c
+void            pcacheinit(void);
+uint64          pcache_get(struct inode*, uint, uint);
+void            pcache_dup(uint64);
+void            pcache_put(uint64);
+void            pcache_inval(uint, uint);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipesetsize(struct pipe*, int);
+int             pipepoll(struct pipe*, int, int);
 
 // printf.c
 int            printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+void            klogdrain(void);
+int             dmesg(uint64, int);
 
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, int*, int);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
@@ -101,7 +145,10 @@ void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+int             sleepuntil(void*, struct spinlock*, uint);
+void            wakedeadlines(void);
 void            userinit(void);
+void            kproc(char*, void (*)(void));
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
@@ -142,9 +189,11 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+uint64          syscall_as(int, uint64, uint64, uint64);
 
 // trap.c
 extern uint     ticks;
+extern struct vdso *vdso;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -153,7 +202,8 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartwrite(char*, int);
+int             uartwrite_nowait(char*, int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -172,11 +222,15 @@ void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+void            ucinit(struct ucursor*, pagetable_t, uint64);
+int             ucin(struct ucursor*, void*, uint64);
+int             ucout(struct ucursor*, void*, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 //lazy allocation 
-int             lazy_alloc(uint64 stval, struct proc *p);
+int             vmfault(struct proc*, uint64, int);
+void            vmprefault(uint64, uint64);
 int             lazy_wr_alloc(uint64 va, struct proc *p);
 
 // plic.c
@@ -21,15 +21,24 @@ int flags2perm(int flags)
 
 int
 exec(char *path, char **argv)
+{
+  return kexec(myproc(), path, argv);
+}
+
+// Replace the user image of p, the current process or one
+// spawn() is creating, with the program in path.
+int
+kexec(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, j, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct vmseg seg[NVMSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
   begin_op();
 
@@ -61,6 +70,23 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if(nseg < NVMSEG && ph.vaddr >= sz){
+      // loaded page by page on first use, by vmfault().
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].filesz = ph.filesz;
+      seg[nseg].memsz = ph.memsz;
+      seg[nseg].off = ph.off;
+      seg[nseg].perm = flags2perm(ph.flags);
+      nseg++;
+      sz = ph.vaddr + ph.memsz;
+      continue;
+    }
+    // an eager segment must not reach into a lazy one's range:
+    // those pages are not mapped, so loadseg() could not fill them.
+    for(j = 0; j < nseg; j++)
+      if(ph.vaddr < seg[j].va + seg[j].memsz &&
+         seg[j].va < ph.vaddr + ph.memsz)
+        goto bad;
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
@@ -68,11 +94,15 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  // keep the reference: the segments are read from ip later,
+  // and the file may not change until the process is done
+  // with it (iexec()).
+  iexec(ip, 1);
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate some pages at the next page boundary.
@@ -122,11 +152,22 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  p->nseg = nseg;
+  memmove(p->seg, seg, sizeof(seg));
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  p->ring = 0;
+  if(oldexe){
+    iexec(oldexe, -1);
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -137,12 +178,18 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    iexec(exe, -1);
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
+// and the pages from va to va+sz should already be mapped.
 // Returns 0 on success, -1 on failure.
 static int
 loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
@@ -153,7 +200,7 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   for(i = 0; i < sz; i += PGSIZE){
     pa = walkaddr(pagetable, va + i);
     if(pa == 0)
-      panic("loadseg: address should exist");
+      return -1;  // a malformed ELF, not a kernel bug
     if(sz - i < PGSIZE)
       n = sz - i;
     else
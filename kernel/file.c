@@ -11,7 +11,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "uio.h"
 #include "proc.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -101,6 +103,27 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// What poll() would find on f: POLL* bits, whatever was asked
+// for. reg is passed on to pipes and the console, which keep
+// count of the polls waiting on them (see poll.c).
+int
+filepoll(struct file *f, int reg)
+{
+  int ev;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, reg);
+  if(f->type == FD_DEVICE && f->major == CONSOLE)
+    ev = consolepoll(reg);
+  else
+    ev = POLLIN | POLLOUT;   // files and other devices never block
+  if(!f->readable)
+    ev &= ~POLLIN;
+  if(!f->writable)
+    ev &= ~POLLOUT;
+  return ev;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -112,12 +135,13 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, 1, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    vmprefault(addr, n);
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
@@ -129,50 +153,109 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Log blocks a writei() of n bytes can touch, other than its
+// data blocks: the i-node, the block an inline file moves to,
+// the extent blocks its runs can spill into, each with up to
+// two indirect blocks above it, and every bitmap block.
+static int
+writemeta(uint64 n)
+{
+  int nblk = (n + BSIZE - 1) / BSIZE;
+
+  return 1 + 1 + 3 * (nblk / NINDEXTENT + 1) + FSSIZE / BPB + 1;
+}
+
+// and its data blocks (+1 if unaligned).
+static int
+writedata(uint64 n)
+{
+  return (n + BSIZE - 1) / BSIZE + 1;
+}
+
+// Bytes inodewrite() writes per transaction: about half a
+// transaction's worth of blocks, or in ordered mode, where the
+// data blocks are not logged, as many as keep the metadata
+// within half a transaction.
+static int
+writechunk(void)
+{
+  int n;
+
+  n = (LOGTXN / 2) * BSIZE;
+  if(log_ordered()){
+    while(n < MAXFILE*BSIZE && writemeta(2*n) <= LOGTXN / 2)
+      n *= 2;
+  }
+  return n;
+}
+
+// Write n bytes from addr to inode file f at *off,
+// advancing *off. addr is a user virtual address if user
+// is set, else a kernel address.
+static int
+inodewrite(struct file *f, int user, uint64 addr, int n, uint *off)
+{
+  int r, n1, stuck;
+
+  // write in chunks of up to half a log transaction, each
+  // reserving only what it can touch, so that a large write
+  // commits a few times instead of once every few blocks
+  // and the rest of the transaction is left for others.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int i = 0;
+  if(user)
+    vmprefault(addr, n);
+  stuck = 0;
+  while(i < n){
+    n1 = n - i;
+    if(n1 > writechunk())
+      n1 = writechunk();
+
+    if(begin_opw(writemeta(n1), writedata(n1)) < 0)
+      continue;  // the log mode changed under writechunk()
+    ilock(f->ip);
+    if ((r = writei(f->ip, user, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_op();
+
+    if(r < 0)
+      break;
+    if(r == 0){
+      // out of disk blocks, or of room in the transaction for
+      // a data block that cannot bypass the log (log_grow()):
+      // commit and try once more.
+      if(stuck++)
+        break;
+      log_force();
+      continue;
+    }
+    // a short write leaves the rest for the next transaction.
+    stuck = 0;
+    i += r;
+  }
+  return (i == n ? n : -1);
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, 1, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    ret = inodewrite(f, 1, addr, n, &f->off);
   } else {
     panic("filewrite");
   }
@@ -180,3 +263,167 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read into the cnt user buffers of iov from file f, at
+// offset off, or at f->off (advancing it) if off < 0.
+// An inode is locked once for the whole vector. Stops at
+// the first short read. Returns the bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, tot, err;
+  uint o;
+
+  if(f->readable == 0)
+    return -1;
+
+  tot = 0;
+  if(f->type != FD_INODE){
+    if(off >= 0)
+      return -1;  // no position to read at
+    for(i = 0; i < cnt; i++){
+      if((r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        return tot ? tot : -1;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    return tot;
+  }
+
+  for(i = 0; i < cnt; i++)
+    vmprefault((uint64)iov[i].iov_base, iov[i].iov_len);
+  ilock(f->ip);
+  o = off < 0 ? f->off : off;
+  err = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = readi(f->ip, 1, (uint64)iov[i].iov_base, o, iov[i].iov_len)) < 0){
+      err = 1;
+      break;
+    }
+    o += r;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  if(off < 0)
+    f->off = o;
+  iunlock(f->ip);
+  return (err && tot == 0) ? -1 : tot;
+}
+
+// Write the cnt user buffers of iov to file f, at offset off,
+// or at f->off (advancing it) if off < 0. If the whole vector
+// fits in one log transaction, an inode file is locked and
+// written in a single transaction; otherwise, or for what
+// that transaction has no room left for, each buffer goes
+// through the chunked path of filewrite().
+// Returns the bytes written, or -1.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, tot, meta, data, done;
+  uint o;
+
+  if(f->writable == 0)
+    return -1;
+
+  tot = 0;
+  if(f->type != FD_INODE){
+    if(off >= 0)
+      return -1;
+    for(i = 0; i < cnt; i++){
+      if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        return tot ? tot : -1;
+      tot += r;
+    }
+    return tot;
+  }
+
+  meta = data = 0;
+  for(i = 0; i < cnt; i++){
+    meta += writemeta(iov[i].iov_len);
+    data += writedata(iov[i].iov_len);
+  }
+
+  for(i = 0; i < cnt; i++)
+    vmprefault((uint64)iov[i].iov_base, iov[i].iov_len);
+  o = off < 0 ? f->off : off;
+  i = done = 0;
+  if(begin_opw(meta, data) == 0){
+    ilock(f->ip);
+    for(; i < cnt; i++){
+      r = writei(f->ip, 1, (uint64)iov[i].iov_base, o, iov[i].iov_len);
+      if(r > 0){
+        o += r;
+        tot += r;
+      }
+      if(r != iov[i].iov_len){
+        done = r > 0 ? r : 0;
+        break;
+      }
+    }
+    iunlock(f->ip);
+    end_op();
+  }
+  for(; i < cnt; i++, done = 0){
+    r = inodewrite(f, 1, (uint64)iov[i].iov_base + done, iov[i].iov_len - done, &o);
+    if(r < 0)
+      break;
+    tot += r;
+  }
+  if(off < 0)
+    f->off = o;
+  // like write(), a short write reports the bytes that landed.
+  if(i < cnt && tot == 0)
+    return -1;
+  return tot;
+}
+
+// Move up to n bytes between a pipe and an inode file (either
+// way) without copying them through user memory: the data goes
+// through one kernel page between the pipe ring and the buffer
+// cache. Stops early at end of file, or when the pipe has no
+// more data right now. Returns the number of bytes moved, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  char *kbuf;
+  int tot, m, r = 0;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(!(in->type == FD_PIPE && out->type == FD_INODE) &&
+     !(in->type == FD_INODE && out->type == FD_PIPE))
+    return -1;
+  if((kbuf = kalloc()) == 0)
+    return -1;
+
+  tot = 0;
+  while(tot < n){
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    if(in->type == FD_PIPE){
+      if((r = piperead(in->pipe, 0, (uint64)kbuf, m)) > 0 &&
+         inodewrite(out, 0, (uint64)kbuf, r, &out->off) != r)
+        r = -1;
+    } else {
+      ilock(in->ip);
+      if((r = readi(in->ip, 0, (uint64)kbuf, in->off, m)) > 0)
+        in->off += r;
+      iunlock(in->ip);
+      if(r > 0 && pipewrite(out->pipe, 0, (uint64)kbuf, r) != r)
+        r = -1;
+    }
+    if(r <= 0)
+      break;
+    tot += r;
+    if(in->type == FD_PIPE && r < m)
+      break;  // pipe drained
+  }
+  kfree(kbuf);
+  if(r < 0 && tot == 0)
+    return -1;
+  return tot;
+}
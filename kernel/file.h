@@ -14,6 +14,11 @@ struct file {
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
 // in-memory copy of an inode
+// bmap() remembers where each extent block starts in the file,
+// so a lookup reads only the extent block that covers it. 32 is
+// every extent block a MAXFILE-block file can need.
+#define NXBLBN 32
+
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
@@ -26,7 +31,26 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  ushort flags;
+  union {
+    struct {
+      struct extent ext[NEXTENT];
+      uint extblk;
+      uint extdbl;
+    };
+    char idata[NINLINE];
+  };
+
+  struct extent xc;   // last extent bmap() found, and
+  uint xclbn;         // the file block it starts at
+  uint xbn;           // extent blocks with a known first file block:
+  uint xblbn[NXBLBN]; // the file block extent block k starts at
+  int pcached;        // has pages in the text page cache
+  int nexec;          // processes running it (p->exe); see iexec()
+
+  struct inode *hnext;  // itable hash chain, and
+  struct inode *prev;   // LRU list of unreferenced inodes,
+  struct inode *next;   // both protected by itable.lock
 };
 
 // map major device number to device functions.
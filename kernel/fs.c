@@ -26,6 +26,22 @@
 // only one device
 struct superblock sb; 
 
+// In-memory summary of the free bitmap: the number of free
+// blocks in each group of BGROUP blocks, so that balloc_run()
+// can skip full groups without reading their bitmap, and a
+// rotor where allocations without a goal continue from.
+// Rebuilt from the bitmap by fsinit(). The counts are only
+// hints; the bitmap (under its buffer lock) has the truth.
+#define BGROUP 256
+#define NBGROUP ((FSSIZE + BGROUP - 1) / BGROUP)
+struct {
+  struct spinlock lock;
+  ushort nfree[NBGROUP];
+  uint rotor;
+} bsum;
+
+static void bsuminit(int);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +60,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
@@ -60,33 +77,112 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-// returns 0 if out of disk space.
-static uint
-balloc(uint dev)
+// Count the free blocks of each group, after log recovery.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b, bi;
 
-  bp = 0;
+  if(sb.size > NBGROUP * BGROUP)
+    panic("bsuminit: fs larger than FSSIZE");
+  initlock(&bsum.lock, "bsum");
   for(b = 0; b < sb.size; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        bsum.nfree[(b + bi) / BGROUP]++;
+    }
+    brelse(bp);
+  }
+  bsum.rotor = sb.bmapstart + (sb.size + BPB - 1) / BPB;
+}
+
+// Adjust the free count of block b's group by d.
+static void
+bsumadd(uint b, int d)
+{
+  acquire(&bsum.lock);
+  bsum.nfree[b / BGROUP] += d;
+  release(&bsum.lock);
+}
+
+// Allocate a run of up to want zeroed disk blocks, as close
+// as possible to block goal (0 = no preference: continue
+// where the last allocation left off). The run never crosses
+// a bitmap block, so only one bitmap block is logged.
+// Groups the summary says are full are skipped unread.
+// The blocks are zeroed (through the log) only if zero is set.
+// Sets *got to the length of the run.
+// returns the first block, or 0 if out of disk space.
+static uint
+balloc_run(uint dev, uint goal, uint want, int zero, uint *got)
+{
+  uint g, g0, ng, k, b, bi, end, first, n, m;
+  struct buf *bp;
+
+  if(goal == 0 || goal >= sb.size)
+    goal = bsum.rotor;
+  if(goal >= sb.size)
+    goal = 0;
+  ng = (sb.size + BGROUP - 1) / BGROUP;
+  g0 = goal / BGROUP;
+
+  // visit the groups starting with the goal's, and finally
+  // the part of the goal's group before the goal.
+  for(k = 0; k <= ng; k++){
+    g = (g0 + k) % ng;
+    if(bsum.nfree[g] == 0)
+      continue;
+    b = (k == 0) ? goal : g * BGROUP;
+    end = (k == ng) ? goal : g * BGROUP + BGROUP;
+    if(end > sb.size)
+      end = sb.size;
+    bp = bread(dev, BBLOCK(b, sb));
+    for(; b < end; b++){
+      bi = b % BPB;
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+        // take the free blocks that follow, up to want,
+        // staying within this bitmap block.
+        first = b;
+        for(n = 0; n < want && b < sb.size && (n == 0 || b % BPB != 0); n++, b++){
+          bi = b % BPB;
+          m = 1 << (bi % 8);
+          if(bp->data[bi/8] & m)
+            break;
+          bp->data[bi/8] |= m;  // Mark block in use.
+          bsumadd(b, -1);
+        }
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        for(b = first; zero && b < first + n; b++)
+          bzero(dev, b);
+        acquire(&bsum.lock);
+        bsum.rotor = first + n;
+        release(&bsum.lock);
+        *got = n;
+        return first;
       }
     }
     brelse(bp);
   }
   printf("balloc: out of blocks\n");
+  *got = 0;
   return 0;
 }
 
+// Allocate a zeroed disk block, next to the last one
+// allocated (usually the file's newest data block).
+// returns 0 if out of disk space.
+static uint
+balloc(uint dev)
+{
+  uint got;
+
+  return balloc_run(dev, 0, 1, 1, &got);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -100,10 +196,19 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bsumadd(b, 1);
   log_write(bp);
   brelse(bp);
 }
 
+// Free the n blocks of a run.
+static void
+bfree_run(int dev, uint b, uint n)
+{
+  while(n-- > 0)
+    bfree(dev, b++);
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -172,21 +277,94 @@ bfree(int dev, uint b)
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// iget() finds entries through a hash table on (dev, inum).
+// An entry whose ref falls to zero stays in the hash table,
+// still valid, and goes on an LRU list; iget() of the same
+// i-node takes it back without re-reading the dinode, and
+// when an entry is needed for another i-node the least
+// recently used one is recycled. The table starts with NINODE
+// entries and grows a page of entries at a time, up to
+// NINODEMAX, instead of recycling valid ones.
+
+#define NIHASH 61
 
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+
+  // Unreferenced inodes, through prev/next.
+  // head.next is the most recently used, head.prev the least.
+  struct inode head;
+
+  uint n;                    // entries, static and allocated
+  uint active;               // entries with ref > 0
+  uint hits, misses, reads;
 } itable;
 
+static void dcacheinit(void);
+static void dcache_purge(uint, uint);
+
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Put ip on the LRU list: at the front if it still holds a
+// valid i-node, at the back (reused first) if not.
+static void
+ilru_add(struct inode *ip)
+{
+  struct inode *at;
+
+  at = ip->valid ? &itable.head : itable.head.prev;
+  ip->next = at->next;
+  ip->prev = at;
+  at->next->prev = ip;
+  at->next = ip;
+}
+
+static void
+ilru_del(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Add a page of fresh entries to the table.
+// Caller holds itable.lock.
+static int
+igrow(void)
+{
+  struct inode *ip, *end;
+
+  if(itable.n >= NINODEMAX || (ip = (struct inode*)kalloc()) == 0)
+    return -1;
+  memset(ip, 0, PGSIZE);
+  for(end = ip + PGSIZE/sizeof(*ip); ip < end; ip++){
+    initsleeplock(&ip->lock, "inode");
+    ilru_add(ip);
+    itable.n++;
+  }
+  return 0;
+}
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
+  dcacheinit();
+  itable.head.prev = &itable.head;
+  itable.head.next = &itable.head;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    ilru_add(&itable.inode[i]);
   }
+  itable.n = NINODE;
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -208,6 +386,8 @@ ialloc(uint dev, short type)
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(type != T_DEVICE)
+        dip->flags = DI_INLINE;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
@@ -235,7 +415,8 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
+  memmove(dip->idata, ip->idata, NINLINE);
   log_write(bp);
   brelse(bp);
 }
@@ -246,31 +427,52 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0){
+        ilru_del(ip);
+        itable.active++;
+      }
+      itable.hits++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  }
+  itable.misses++;
+
+  // Recycle the least recently used entry, unless it
+  // still caches an i-node and the table can grow.
+  ip = itable.head.prev;
+  if(ip == &itable.head || ip->valid){
+    if(igrow() == 0)
+      ip = itable.head.prev;
+    if(ip == &itable.head)
+      panic("iget: no inodes");
+  }
+  ilru_del(ip);
+  if(ip->pcached){
+    pcache_inval(ip->dev, ip->inum);
+    ip->pcached = 0;
+  }
+  if(ip->inum){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  *pp = ip;
+  itable.active++;
   release(&itable.lock);
 
   return ip;
@@ -287,6 +489,22 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Add d to the count of processes running the program in ip,
+// which the caller holds a reference to. While the count is
+// non-zero writei() refuses to change ip, and open() to open
+// it for writing: the pages vmfault() has yet to read must be
+// those of the image exec() checked. Going from 0 to 1, the
+// caller also holds ip->lock, so no write is in progress.
+void
+iexec(struct inode *ip, int d)
+{
+  acquire(&itable.lock);
+  ip->nexec += d;
+  if(ip->nexec < 0)
+    panic("iexec");
+  release(&itable.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -308,9 +526,14 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
+    memmove(ip->idata, dip->idata, NINLINE);
+    ip->xc.len = ip->xbn = 0;
     brelse(bp);
     ip->valid = 1;
+    acquire(&itable.lock);
+    itable.reads++;
+    release(&itable.lock);
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -347,6 +570,8 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -357,7 +582,10 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    ilru_add(ip);
+    itable.active--;
+  }
   release(&itable.lock);
 }
 
@@ -372,52 +600,196 @@ iunlockput(struct inode *ip)
 // Inode content
 //
 // The content (data) associated with each inode is stored
-// in blocks on the disk. The first NDIRECT block numbers
-// are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// in blocks on the disk, described by extents (see fs.h).
+// The first NEXTENT extents are in ip->ext[], the rest in
+// extent blocks reached through ip->extblk and ip->extdbl.
+//
+// Blocks are allocated when a write reaches them, but a write
+// allocates the runs for all of its blocks at once, right after
+// the last extent when possible, so files come out contiguous
+// and usually need a single extent.
+
+// Return entry idx of the block-number array in block *bp,
+// allocating the array block and the entry if alloc is set.
+// returns 0 if not present or out of disk space.
+static uint
+indslot(struct inode *ip, uint *bp, uint idx, int alloc)
+{
+  struct buf *b;
+  uint *a, addr;
+
+  if(*bp == 0){
+    if(!alloc || (*bp = balloc(ip->dev)) == 0)
+      return 0;
+  }
+  b = bread(ip->dev, *bp);
+  a = (uint*)b->data;
+  if((addr = a[idx]) == 0 && alloc){
+    if((addr = balloc(ip->dev)) != 0){
+      a[idx] = addr;
+      log_write(b);
+    }
+  }
+  brelse(b);
+  return addr;
+}
+
+// Return the disk address of the kth extent block of ip,
+// allocating it (and the indirect blocks leading to it)
+// if alloc is set. returns 0 if there is no such block.
+static uint
+extblock(struct inode *ip, uint k, int alloc)
+{
+  if(k == 0){
+    if(ip->extblk == 0 && alloc)
+      ip->extblk = balloc(ip->dev);
+    return ip->extblk;
+  }
+  k -= 1;
+
+  if(k < NINDPTR)
+    return indslot(ip, &ip->extdbl, k, alloc);
+  panic("extblock: out of range");
+}
+
+// Store extent *e in slot idx of extent block blk,
+// or of ip->ext[] if blk is 0.
+static void
+putext(struct inode *ip, uint blk, uint idx, struct extent *e)
+{
+  struct buf *bp;
+
+  if(blk == 0){
+    ip->ext[idx] = *e;
+    return;
+  }
+  bp = bread(ip->dev, blk);
+  ((struct extent*)bp->data)[idx] = *e;
+  log_write(bp);
+  brelse(bp);
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
-// returns 0 if out of disk space.
+// If there is no such block and want > 0, bmap allocates a run
+// of up to want blocks starting at bn (the blocks the caller
+// is about to write).
+// returns 0 if not mapped or out of disk space (or extents).
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, uint want)
 {
-  uint addr, *a;
+  uint lbn, lastlbn, lastblk, lastidx, blk, addr, got, goal;
+  int k, k0, j;
+  struct extent *e, last, x;
   struct buf *bp;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr == 0)
-        return 0;
-      ip->addrs[bn] = addr;
+  if(ip->flags & DI_INLINE)
+    panic("bmap: inline");
+
+  // Most lookups hit the same extent as the previous one,
+  // which saves walking the extent blocks.
+  if(ip->xc.len && bn >= ip->xclbn && bn < ip->xclbn + ip->xc.len)
+    return ip->xc.start + (bn - ip->xclbn);
+
+  // Walk the extents in file order. k is the extent block
+  // being looked at (-1 for the inode), j the slot in it.
+  // Start at the last extent block known to begin at or
+  // before bn, so that only the block covering bn is read.
+  lbn = 0;
+  k0 = -1;
+  for(j = ip->xbn - 1; j >= 0; j--){
+    if(ip->xblbn[j] <= bn){
+      k0 = j;
+      lbn = ip->xblbn[j];
+      break;
     }
-    return addr;
   }
-  bn -= NDIRECT;
-
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
-      if(addr == 0)
-        return 0;
-      ip->addrs[NDIRECT] = addr;
+  lastlbn = lastblk = lastidx = 0;
+  last.start = last.len = 0;
+  blk = 0;
+  for(k = k0; k < (int)NEXTBLK; k++){
+    if(k < 0){
+      bp = 0;
+      e = ip->ext;
+    } else {
+      if((blk = extblock(ip, k, 0)) == 0){
+        j = 0;
+        goto unmapped;
+      }
+      if(k == ip->xbn && k < NXBLBN)
+        ip->xblbn[ip->xbn++] = lbn;
+      bp = bread(ip->dev, blk);
+      e = (struct extent*)bp->data;
     }
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
+    for(j = 0; j < (k < 0 ? NEXTENT : NINDEXTENT); j++){
+      if(e[j].len == 0){
+        if(bp)
+          brelse(bp);
+        goto unmapped;
+      }
+      if(bn < lbn + e[j].len){
+        ip->xc = e[j];
+        ip->xclbn = lbn;
+        if(bp)
+          brelse(bp);
+        return ip->xc.start + (bn - lbn);
       }
+      last = e[j];
+      lastlbn = lbn;
+      lastblk = blk;
+      lastidx = j;
+      lbn += e[j].len;
     }
-    brelse(bp);
-    return addr;
+    if(bp)
+      brelse(bp);
   }
+  return 0;  // out of extents
 
-  panic("bmap: out of range");
+unmapped:
+  // Allocate the run [lbn, bn+want) into slot j of extent
+  // block k. Files have no holes, so bn == lbn for a write.
+  if(want == 0 || bn != lbn)
+    return 0;
+  goal = last.len ? last.start + last.len : 0;
+  // data blocks of regular files are not zeroed: the caller
+  // is about to write them, and bytes past ip->size are never
+  // read. Logging the zeroes would also defeat log_bypass().
+  if((addr = balloc_run(ip->dev, goal, want, ip->type != T_FILE, &got)) == 0)
+    return 0;
+
+  if(last.len && addr == last.start + last.len){
+    // contiguous with the last extent: just grow it.
+    last.len += got;
+    putext(ip, lastblk, lastidx, &last);
+    ip->xc = last;
+    ip->xclbn = lastlbn;
+  } else {
+    if(k >= 0 && (blk = extblock(ip, k, 1)) == 0){
+      bfree_run(ip->dev, addr, got);
+      return 0;
+    }
+    x.start = addr;
+    x.len = got;
+    putext(ip, k < 0 ? 0 : blk, j, &x);
+    ip->xc = x;
+    ip->xclbn = lbn;
+  }
+  return addr;
+}
+
+// Free every run listed in extent block blk, then blk.
+static void
+freeextblk(struct inode *ip, uint blk)
+{
+  struct buf *bp;
+  struct extent *e;
+  int j;
+
+  bp = bread(ip->dev, blk);
+  e = (struct extent*)bp->data;
+  for(j = 0; j < NINDEXTENT && e[j].len != 0; j++)
+    bfree_run(ip->dev, e[j].start, e[j].len);
+  brelse(bp);
+  bfree(ip->dev, blk);
 }
 
 // Truncate inode (discard contents).
@@ -425,30 +797,44 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+  uint k, blk;
 
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
+  if(ip->pcached){
+    pcache_inval(ip->dev, ip->inum);
+    ip->pcached = 0;
+  }
+
+  if(ip->flags & DI_INLINE){
+    memset(ip->idata, 0, NINLINE);
+    ip->size = 0;
+    iupdate(ip);
+    return;
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  for(i = 0; i < NEXTENT; i++){
+    if(ip->ext[i].len){
+      bfree_run(ip->dev, ip->ext[i].start, ip->ext[i].len);
+      ip->ext[i].start = 0;
+      ip->ext[i].len = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
+  // extent blocks are filled in order, so stop at the first
+  // missing one. the indirect block is freed afterwards
+  // because extblock() reads it.
+  for(k = 0; k < NEXTBLK && (blk = extblock(ip, k, 0)) != 0; k++)
+    freeextblk(ip, blk);
+  ip->extblk = 0;
+  if(ip->extdbl){
+    bfree(ip->dev, ip->extdbl);
+    ip->extdbl = 0;
+  }
+
+  ip->xc.len = ip->xbn = 0;
   ip->size = 0;
+  if(ip->type != T_DEVICE)
+    ip->flags |= DI_INLINE;
   iupdate(ip);
 }
 
@@ -464,6 +850,36 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Move the content of an inline inode out to a data block,
+// allocating want blocks as one run for the write that
+// doesn't fit. Caller must hold ip->lock.
+static int
+iunline(struct inode *ip, uint want)
+{
+  char data[NINLINE];
+  struct buf *bp;
+  uint addr;
+
+  memmove(data, ip->idata, ip->size);
+  memset(ip->idata, 0, NINLINE);
+  ip->flags &= ~DI_INLINE;
+  ip->xc.len = ip->xbn = 0;
+  if((addr = bmap(ip, 0, want)) == 0){
+    // out of blocks: stay inline.
+    memmove(ip->idata, data, ip->size);
+    ip->flags |= DI_INLINE;
+    return -1;
+  }
+  bp = bread(ip->dev, addr);
+  memmove(bp->data, data, ip->size);
+  if(ip->type == T_FILE && log_bypass(addr))
+    bwrite(bp);
+  else
+    log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -479,8 +895,14 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, ip->idata + off, n) == -1)
+      return -1;
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    uint addr = bmap(ip, off/BSIZE);
+    uint addr = bmap(ip, off/BSIZE, 0);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
@@ -506,6 +928,7 @@ int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
+  int home;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
@@ -513,17 +936,51 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // a running program's file must not change under it (iexec());
+  // pages cached from earlier runs are stale after the write.
+  if(ip->nexec > 0)
+    return -1;
+  if(ip->pcached){
+    pcache_inval(ip->dev, ip->inum);
+    ip->pcached = 0;
+  }
+
+  if(ip->flags & DI_INLINE){
+    if(off + n <= NINLINE){
+      if(either_copyin(ip->idata + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if(iunline(ip, (off + n - 1)/BSIZE + 1) < 0)
+      return -1;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    uint addr = bmap(ip, off/BSIZE);
+    // blocks this write still has to touch, so that
+    // bmap() can allocate them as one run.
+    uint want = (off + (n - tot) - 1)/BSIZE - off/BSIZE + 1;
+    uint addr = bmap(ip, off/BSIZE, want);
     if(addr == 0)
       break;
+    // in ordered mode file data goes straight home, ahead of
+    // the commit of the metadata that points to it. A block
+    // that cannot was not reserved, and may not fit.
+    home = ip->type == T_FILE && log_bypass(addr);
+    if(!home && ip->type == T_FILE && !log_grow(addr))
+      break;
     bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
-    log_write(bp);
+    if(home)
+      bwrite(bp);
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -531,8 +988,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     ip->size = off;
 
   // write the i-node back to disk even if the size didn't change
-  // because the loop above might have called bmap() and added a new
-  // block to ip->addrs[].
+  // because the loop above might have called bmap() and added or
+  // grown an extent in ip->ext[].
   iupdate(ip);
 
   return tot;
@@ -546,8 +1003,150 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Name cache.
+//
+// Remembers the result of recent dirlookup()s, keyed by
+// (directory, name): the inode number and dirent offset of the
+// entry, or inum 0 for a name that is not there (a negative
+// entry), so that path resolution does not re-read directories.
+// The cache is NDSET sets of NDWAY entries; a name hashes to a
+// set and replaces its least recently used entry.
+//
+// Directory contents only change in dirlink() and dirunlink(),
+// which update the cache while holding the directory's lock,
+// and dirlookup() fills it under that same lock, so an entry is
+// never stale. When a directory inode is freed its entries are
+// purged (dcache_purge()) before its inum can be reused.
+#define NDSET 64
+#define NDWAY 4
+
+struct dentry {
+  uint dev;
+  uint dir;            // inum of the directory, 0 if unused
+  char name[DIRSIZ];
+  uint inum;           // 0: name not present
+  uint off;            // offset of the dirent in dir
+  uint used;           // dcache.clock at last use
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry e[NDSET][NDWAY];
+  uint clock;
+  uint hits, misses;
+} dcache;
+
+static void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dcache_set(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return dcache.e[h % NDSET];
+}
+
+// Look (dir, name) up. Returns 1 and fills *inum and *off on
+// a hit (*inum is 0 for a negative entry), 0 on a miss.
+static int
+dcache_get(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+  int i, hit;
+
+  acquire(&dcache.lock);
+  d = dcache_set(dp->dev, dp->inum, name);
+  hit = 0;
+  for(i = 0; i < NDWAY; i++, d++){
+    if(d->dir == dp->inum && d->dev == dp->dev &&
+       namecmp(d->name, name) == 0){
+      d->used = ++dcache.clock;
+      *inum = d->inum;
+      *off = d->off;
+      hit = 1;
+      break;
+    }
+  }
+  if(hit)
+    dcache.hits++;
+  else
+    dcache.misses++;
+  release(&dcache.lock);
+  return hit;
+}
+
+// Record that name in dp is inum at offset off (inum 0: absent).
+static void
+dcache_put(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d, *victim;
+  int i;
+
+  acquire(&dcache.lock);
+  d = dcache_set(dp->dev, dp->inum, name);
+  victim = d;
+  for(i = 0; i < NDWAY; i++, d++){
+    if(d->dir == dp->inum && d->dev == dp->dev &&
+       namecmp(d->name, name) == 0){
+      victim = d;
+      break;
+    }
+    if(d->dir == 0 || d->used < victim->used)
+      victim = d;
+  }
+  victim->dev = dp->dev;
+  victim->dir = dp->inum;
+  strncpy(victim->name, name, DIRSIZ);
+  victim->inum = inum;
+  victim->off = off;
+  victim->used = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory (dev, dir), which is being freed.
+static void
+dcache_purge(uint dev, uint dir)
+{
+  int s, i;
+
+  acquire(&dcache.lock);
+  for(s = 0; s < NDSET; s++){
+    for(i = 0; i < NDWAY; i++){
+      if(dcache.e[s][i].dir == dir && dcache.e[s][i].dev == dev)
+        dcache.e[s][i].dir = 0;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Copy the inode and name cache counters to *st.
+void
+fsstat(struct fsstat *st)
+{
+  acquire(&itable.lock);
+  st->ninode = itable.n;
+  st->iactive = itable.active;
+  st->ihits = itable.hits;
+  st->imisses = itable.misses;
+  st->ireads = itable.reads;
+  release(&itable.lock);
+  acquire(&dcache.lock);
+  st->dhits = dcache.hits;
+  st->dmisses = dcache.misses;
+  release(&dcache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -557,6 +1156,14 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_get(dp, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -564,6 +1171,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       continue;
     if(namecmp(name, de.name) == 0){
       // entry matches path element
+      dcache_put(dp, name, de.inum, off);
       if(poff)
         *poff = off;
       inum = de.inum;
@@ -571,6 +1179,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
     }
   }
 
+  dcache_put(dp, name, 0, 0);
   return 0;
 }
 
@@ -601,10 +1210,24 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcache_put(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, found by dirlookup() at offset
+// off, from the directory dp. Caller must hold dp->lock.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+  dcache_put(dp, name, 0, 0);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -24,9 +24,34 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
-#define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+// Log mode bits for logmode()
+#define LOG_ASYNC   0x1   // group commit
+#define LOG_ORDERED 0x2   // file data bypasses the log
+
+// A file's content is a list of extents: runs of consecutive
+// disk blocks. Files have no holes, so extent i covers the file
+// blocks right after those of extent i-1. The first NEXTENT
+// extents live in the inode; the rest in extent blocks of
+// NINDEXTENT each. Extent block 0 is extblk, the next NINDPTR
+// are listed in the doubly-indirect block extdbl.
+struct extent {
+  uint start;           // First disk block of the run
+  uint len;             // Number of blocks (0 = unused slot)
+};
+
+#define NEXTENT 5
+#define NINDEXTENT (BSIZE / sizeof(struct extent))
+#define NINDPTR (BSIZE / sizeof(uint))
+#define NEXTBLK (1 + NINDPTR)
+#define MAXFILE 4096    // max file size in blocks
+
+// A file or directory of at most NINLINE bytes is kept in the
+// inode itself (DI_INLINE), in the space the extent map would
+// use, and needs no data blocks. writei() moves it out to a
+// block when it grows past NINLINE; itrunc() makes it inline
+// again.
+#define NINLINE 240
+#define DI_INLINE 0x1
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +60,16 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  ushort flags;         // DI_INLINE
+  ushort pad;
+  union {
+    struct {
+      struct extent ext[NEXTENT]; // Data block runs
+      uint extblk;      // Block holding more extents
+      uint extdbl;      // Block listing extent blocks
+    };
+    char idata[NINLINE];  // Content, if DI_INLINE
+  };
 };
 
 // Inodes per block.
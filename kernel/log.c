@@ -18,143 +18,360 @@
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// But if it thinks the transaction is close to running out
+// of room, it sleeps until the last outstanding end_op() commits.
+// begin_op() reserves MAXOPBLOCKS; calls that know they need
+// less (or more) use begin_opn(n), and writes to regular files
+// begin_opw(), which leaves out the data blocks in ordered mode.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
+// In asynchronous mode (log.async, see sys_logmode()) the last
+// end_op() does not commit right away: transactions from many
+// processes are grouped into a single commit, which happens when
+// the log is nearly full, LOGTICKS ticks after the first block
+// was logged, or when someone calls fsync() (log_force()). The
+// deadline is checked by end_op() and, for a group left pending
+// when FS calls stop, by the logflush kernel process.
+// A crash may lose the last uncommitted group, but never leaves
+// the file system inconsistent.
+//
+// In ordered mode (log.ordered) writei() writes the data blocks
+// of regular files directly to their home location instead of
+// logging them (see log_bypass()), before the transaction that
+// allocates them commits; only metadata (inodes, bitmap,
+// directories, extent blocks) goes through the log, and only
+// metadata is reserved for such writes (begin_opw()). A crash can
+// then leave new data in blocks the committed metadata does not
+// point to yet, or a partly overwritten file, but not metadata
+// pointing at blocks that were never written. As in ext3 without
+// revoke records, a block freed by a transaction that has not
+// committed yet may be reused and overwritten before the free is
+// durable.
+//
+// The log is a physical re-do log containing disk blocks,
+// used as a circular buffer. The on-disk log format:
+//   header block, containing the tail of the log (oldest
+//     transaction not yet installed) and its sequence number
+//   ring of sb.nlog-1 blocks, holding one record per commit:
+//     descriptor block: magic, seq, block #s for A, B, C, ...
+//     block A
+//     block B
+//     ...
+// A commit appends its blocks and then its descriptor; writing
+// the descriptor is the commit point. Committed blocks are not
+// copied to their home locations right away: they stay in the
+// ring, and bread() finds them there through log.map until a
+// checkpoint() installs every pending block and moves the tail.
+// Checkpoints happen when the ring no longer has room for a
+// whole transaction, so many commits share one installation.
 // Log appends are synchronous.
 
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// Contents of a descriptor block, and in memory the list of
+// blocks logged by the transaction being built.
 struct logheader {
+  uint magic;
+  uint seq;
   int n;
-  int block[LOGSIZE];
+  int block[LOGTXN];
 };
 
+// Contents of the log header block.
+struct logtail {
+  uint tail;       // ring index of the oldest record
+  uint seq;        // sequence number of that record
+};
+
+#define LOGMAGIC 0x6c6f6721
+#define LOGMAPSZ (2*LOGSIZE)  // open hash of home block -> ring index
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // blocks reserved by begin_opn() since last commit.
   int committing;  // in commit(), please wait.
   int dev;
+  int async;       // group commit: end_op() may defer the commit.
+  int ordered;     // file data bypasses the log (log_bypass()).
+  int forcing;     // log_force() waits for a commit; hold new ops.
+  uint ncommit;    // number of commit()s completed.
+  uint opened;     // ticks when the first block of lh was logged.
+  uint tail;       // ring index of the oldest uninstalled record
+  uint head;       // ring index where the next record goes (mod ring)
+  uint seq;        // sequence number of the next record
+  int nreaders;    // log_read()s in progress on ring blocks
+  struct {
+    uint home;     // 0 if the slot is free
+    uint pos;      // ring index of the newest copy
+  } map[LOGMAPSZ];
+  int nmap;
   struct logheader lh;
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void commit_locked(void);
+static void logflusher(void);
+
+// Disk block holding ring index i.
+static uint
+ringblock(uint i)
+{
+  return log.start + 1 + i % (log.size - 1);
+}
+
+// Blocks of the ring in use by committed, uninstalled records.
+static uint
+ringused(void)
+{
+  return (log.head + (log.size - 1) - log.tail) % (log.size - 1);
+}
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
+  if (sb->nlog > LOGSIZE || sb->nlog < 2*(LOGTXN+1) + 1)
+    panic("initlog: bad log size");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.async = LOGASYNC;
+  log.ordered = LOGORDERED;
   recover_from_log();
+  kproc("logflush", logflusher);
 }
 
-// Copy committed blocks from log to their home location
+// Find the ring index holding the newest committed copy of
+// home block b. Caller holds log.lock. Returns -1 if none.
+static int
+map_lookup(uint b)
+{
+  uint h;
+
+  for(h = b % LOGMAPSZ; log.map[h].home != 0; h = (h + 1) % LOGMAPSZ){
+    if(log.map[h].home == b)
+      return log.map[h].pos;
+  }
+  return -1;
+}
+
+// Record that ring index pos holds the newest copy of b.
+// Caller holds log.lock.
 static void
-install_trans(int recovering)
+map_insert(uint b, uint pos)
 {
-  int tail;
+  uint h;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  for(h = b % LOGMAPSZ; log.map[h].home != 0; h = (h + 1) % LOGMAPSZ){
+    if(log.map[h].home == b){
+      log.map[h].pos = pos;
+      return;
+    }
   }
+  if(log.nmap >= LOGMAPSZ - 1)
+    panic("log map full");
+  log.map[h].home = b;
+  log.map[h].pos = pos;
+  log.nmap++;
 }
 
-// Read the log header from disk into the in-memory log header
+// Called by bread() for a block that is not in the cache.
+// If the newest copy of the block is still in the ring
+// (committed but not yet installed), read it from there.
+// Returns 1 if b->data was filled, 0 if the caller should
+// read the home location.
+int
+log_read(struct buf *b)
+{
+  struct buf *lb;
+  int pos;
+
+  if(log.size == 0 || b->dev != log.dev)
+    return 0;   // before initlog()
+
+  acquire(&log.lock);
+  if(log.nmap == 0 || (pos = map_lookup(b->blockno)) < 0){
+    release(&log.lock);
+    return 0;
+  }
+  // keep checkpoint() from recycling the ring block.
+  log.nreaders++;
+  release(&log.lock);
+
+  lb = bread(log.dev, ringblock(pos));
+  memmove(b->data, lb->data, BSIZE);
+  brelse(lb);
+
+  acquire(&log.lock);
+  if(--log.nreaders == 0)
+    wakeup(&log.nreaders);
+  release(&log.lock);
+  return 1;
+}
+
+// Write the tail of the log to the header block.
 static void
-read_head(void)
+write_tail(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+  struct logtail *lt = (struct logtail *) (buf->data);
+
+  lt->tail = log.tail;
+  lt->seq = log.seq;
+  bwrite(buf);
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Copy every committed block still in the ring to its home
+// location, then mark the ring empty.
+// Only called from commit(), so no FS system call is active
+// and the cache holds exactly the committed contents.
 static void
-write_head(void)
+checkpoint(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *b;
+
+  for(i = 0; i < LOGMAPSZ; i++){
+    if(log.map[i].home == 0)
+      continue;
+    b = bread(log.dev, log.map[i].home); // cache or ring copy
+    bwrite(b);
+    brelse(b);
   }
-  bwrite(buf);
-  brelse(buf);
+
+  log.tail = log.head;
+  write_tail();  // the ring is empty from here on
+
+  acquire(&log.lock);
+  memset(log.map, 0, sizeof(log.map));
+  log.nmap = 0;
+  while(log.nreaders > 0)
+    sleep(&log.nreaders, &log.lock);
+  release(&log.lock);
 }
 
+// Replay committed records, oldest first, into their
+// home locations and empty the ring.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *buf, *lbuf, *dbuf;
+  struct logtail *lt;
+  struct logheader *lh;
+  uint pos, seq;
+  int i, n;
+
+  buf = bread(log.dev, log.start);
+  lt = (struct logtail *) (buf->data);
+  pos = lt->tail % (log.size - 1);
+  seq = lt->seq;
+  brelse(buf);
+
+  for(;;){
+    buf = bread(log.dev, ringblock(pos));
+    lh = (struct logheader *) (buf->data);
+    n = lh->n;
+    if(lh->magic != LOGMAGIC || lh->seq != seq || n <= 0 || n > LOGTXN){
+      brelse(buf);
+      break;
+    }
+    for(i = 0; i < n; i++){
+      lbuf = bread(log.dev, ringblock(pos+1+i)); // read log block
+      dbuf = bread(log.dev, lh->block[i]);       // read dst
+      memmove(dbuf->data, lbuf->data, BSIZE);    // copy block to dst
+      bwrite(dbuf);  // write dst to disk
+      brelse(lbuf);
+      brelse(dbuf);
+    }
+    brelse(buf);
+    pos = (pos + 1 + n) % (log.size - 1);
+    seq++;
+  }
+
+  log.tail = log.head = pos;
+  log.seq = seq;
+  write_tail(); // clear the log
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that writes
+// at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
+{
+  if(n > LOGTXN)
+    panic("begin_opn: too many blocks");
+  begin_opw(n, 0);
+}
+
+// called at the start of a write to a regular file that logs
+// at most meta metadata blocks and data data blocks. In
+// ordered mode the data blocks go straight home, so only meta
+// is reserved; writei() asks log_grow() for any that cannot.
+// Returns -1, without starting an op, if that is more than
+// one transaction holds.
+int
+begin_opw(int meta, int data)
 {
+  int n;
+
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    n = meta + (log.ordered ? 0 : data);
+    if(n > LOGTXN){
+      release(&log.lock);
+      return -1;
+    }
+    if(log.committing || log.forcing){
       sleep(&log, &log.lock);
+    } else if(log.lh.n + log.reserved + n > LOGTXN){
+      // this op might overflow the transaction; wait for commit.
+      if(log.outstanding == 0){
+        // a deferred (async) group is pending and nobody
+        // else is going to commit it.
+        commit_locked();
+      } else {
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
-      break;
+      return 0;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation,
+// unless the log is in async mode and the group can wait.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    // blocks used by finished ops are now counted in lh.n.
+    log.reserved = 0;
+  }
+  if(log.outstanding == 0 && (!log.async || log.forcing ||
+     log.lh.n + MAXOPBLOCKS > LOGTXN ||
+     ticks - log.opened >= LOGTICKS)){
+    commit_locked();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -162,26 +379,161 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Commit the current group. Caller holds log.lock and
+// there must be no outstanding FS system calls.
+// Drops the lock around commit(), since we are not
+// allowed to sleep with locks held.
+static void
+commit_locked(void)
+{
+  log.committing = 1;
+  release(&log.lock);
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  log.forcing = 0;
+  log.ncommit++;
+  wakeup(&log);
+}
+
+// Make every completed FS system call durable:
+// commit the pending group and wait for it.
+// Used by fsync().
+void
+log_force(void)
+{
+  uint n;
+
+  acquire(&log.lock);
+  while(log.committing)
+    sleep(&log, &log.lock);
+  if(log.lh.n > 0){
+    if(log.outstanding == 0){
+      commit_locked();
+    } else {
+      // stop new ops; the last end_op() will commit.
+      log.forcing = 1;
+      n = log.ncommit;
+      while(log.ncommit == n)
+        sleep(&log, &log.lock);
+    }
+  }
+  release(&log.lock);
+}
+
+// Set the log mode: LOG_ASYNC selects group commit instead of
+// a commit per operation, LOG_ORDERED lets file data bypass the
+// log. Returns the previous mode. Switching to sync mode
+// commits whatever is pending.
+int
+log_setmode(int mode)
+{
+  int old;
+
+  acquire(&log.lock);
+  // what begin_opw() reserved depends on log.ordered, so it
+  // only changes between ops: hold new ones and let the
+  // running ones finish.
+  while(log.outstanding > 0 || log.committing){
+    log.forcing = 1;
+    sleep(&log, &log.lock);
   }
+  old = (log.async ? LOG_ASYNC : 0) | (log.ordered ? LOG_ORDERED : 0);
+  log.async = (mode & LOG_ASYNC) != 0;
+  log.ordered = (mode & LOG_ORDERED) != 0;
+  wakeup(&log.opened);
+  release(&log.lock);
+  if(!(mode & LOG_ASYNC))
+    log_force();
+  return old;
 }
 
-// Copy modified blocks from cache to log.
+// Body of the logflush kernel process. In async mode, commits
+// the pending group once LOGTICKS have passed since its first
+// block was logged, if no end_op() has done it by then. While
+// FS calls are outstanding, the last end_op() sees the deadline
+// itself.
+static void
+logflusher(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(!log.async || log.lh.n == 0){
+      sleep(&log.opened, &log.lock);
+    } else if(ticks - log.opened < LOGTICKS){
+      sleepuntil(&log.opened, &log.lock, log.opened + LOGTICKS);
+    } else if(log.committing || log.outstanding > 0){
+      sleep(&log, &log.lock);
+    } else {
+      commit_locked();
+    }
+  }
+}
+
+// In ordered mode, may block b (a data block of a regular
+// file, locked by the caller) be written in place with bwrite()
+// instead of log_write()? Not if an older copy of b is in the
+// transaction being built or in the ring: committing or
+// installing that copy later would overwrite the new data. This
+// happens when a recently freed metadata block is reused for data.
+int
+log_bypass(uint b)
+{
+  int i, ok;
+
+  acquire(&log.lock);
+  ok = log.ordered && map_lookup(b) < 0;
+  for(i = 0; ok && i < log.lh.n; i++){
+    if(log.lh.block[i] == b)
+      ok = 0;
+  }
+  release(&log.lock);
+  return ok;
+}
+
+// In ordered mode, a data block of a regular file that may not
+// bypass the log was not reserved by begin_opw(): take room for
+// it from what the transaction has left. Returns 0 if there is
+// none, and the caller must stop its write short; 1 if b may be
+// logged. Never waits, since the caller is inside an op.
+int
+log_grow(uint b)
+{
+  int i, ok;
+
+  acquire(&log.lock);
+  ok = !log.ordered;
+  for(i = 0; !ok && i < log.lh.n; i++){
+    if(log.lh.block[i] == b)
+      ok = 1;  // absorbed: takes no new slot
+  }
+  if(!ok && log.lh.n + log.reserved + 1 <= LOGTXN){
+    log.reserved++;
+    ok = 1;
+  }
+  release(&log.lock);
+  return ok;
+}
+
+// Is the log in ordered mode? Only stable inside an op; others
+// may use it as a hint.
+int
+log_ordered(void)
+{
+  return log.ordered;
+}
+
+// Copy modified blocks from cache to the ring,
+// after the descriptor slot at log.head.
 static void
 write_log(void)
 {
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    struct buf *to = bread(log.dev, ringblock(log.head+1+tail)); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
     bwrite(to);  // write the log
@@ -190,15 +542,54 @@ write_log(void)
   }
 }
 
+// Write the descriptor of the current transaction to disk.
+// This is the true point at which the transaction commits.
+static void
+write_desc(void)
+{
+  struct buf *buf = bread(log.dev, ringblock(log.head));
+  struct logheader *hb = (struct logheader *) (buf->data);
+  int i;
+
+  hb->magic = LOGMAGIC;
+  hb->seq = log.seq;
+  hb->n = log.lh.n;
+  for (i = 0; i < log.lh.n; i++) {
+    hb->block[i] = log.lh.block[i];
+  }
+  bwrite(buf);
+  brelse(buf);
+}
+
 static void
 commit()
 {
+  int i;
+  struct buf *b;
+
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+    write_desc();    // Write descriptor to disk -- the real commit
+
+    // From now on bread() may find these blocks in the ring,
+    // so the cache no longer has to pin them.
+    acquire(&log.lock);
+    for (i = 0; i < log.lh.n; i++)
+      map_insert(log.lh.block[i], (log.head+1+i) % (log.size - 1));
+    release(&log.lock);
+    for (i = 0; i < log.lh.n; i++) {
+      b = bread(log.dev, log.lh.block[i]);
+      bunpin(b);
+      brelse(b);
+    }
+
+    log.head = (log.head + 1 + log.lh.n) % (log.size - 1);
+    log.seq++;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+
+    // Make sure the next transaction fits in the ring.
+    if (ringused() + LOGTXN + 1 > log.size - 1)
+      checkpoint();
   }
 }
 
@@ -217,7 +608,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= LOGTXN)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -229,8 +620,12 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
+    if(log.lh.n == 0){
+      log.opened = ticks;
+      if(log.async)
+        wakeup(&log.opened);  // start logflusher()'s clock
+    }
     log.lh.n++;
   }
   release(&log.lock);
 }
-
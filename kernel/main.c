@@ -26,7 +26,9 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    pcacheinit();    // text page cache
     fileinit();      // file table
+    pollinit();      // poll() wait queue
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
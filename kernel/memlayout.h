@@ -54,6 +54,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   URING (p->ring, if ring_setup() was called, see uring.h)
+//   UPROC (p->uproc, read-only, see vdso.h)
+//   VDSO (the same page in every process, read-only)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO (TRAPFRAME - PGSIZE)
+#define UPROC (VDSO - PGSIZE)
+#define URING (UPROC - PGSIZE)
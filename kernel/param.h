@@ -2,13 +2,19 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // i-nodes in the in-memory table at boot
+#define NINODEMAX  1000  // the table grows up to this many i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      1024  // blocks in the on-disk (circular) log
+#define LOGTXN       200   // max blocks in one commit (fits a descriptor)
+#define LOGASYNC     0     // start the log in async (group commit) mode?
+#define LOGTICKS     10    // max ticks an async group waits before commit
+#define LOGORDERED   1     // start the log in ordered mode (data bypasses it)?
+#define NPCACHE     256  // pages in the text page cache
+#define NBUF         (LOGTXN+100)  // size of disk block cache
 #define FSSIZE       10000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
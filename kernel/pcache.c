@@ -0,0 +1,259 @@
+// Text page cache.
+//
+// Pages of read-only program segments, keyed by the file they
+// come from and the offset in it, so that every process running
+// the same binary maps the same physical pages, and a new exec
+// of a binary that ran recently finds its text already in memory.
+// vmfault() maps these pages with PTE_S set; uvmunmap() hands
+// them back with pcache_put() instead of freeing them, and
+// uvmcopy() shares them with pcache_dup() instead of copying.
+//
+// An entry counts the mappings of its page. A page nobody maps
+// stays cached until its slot is needed for another page, the
+// least recently used one going first. Entries are hashed by
+// (dev, inum, off) for pcache_get() and by page for the others,
+// and the ones nobody maps are kept on an LRU list, so none of
+// them scans the table. Writing or truncating
+// the file drops its pages (pcache_inval()): unmapped ones are
+// freed, mapped ones are unhooked from the file and freed by
+// their last pcache_put().
+//
+// An inode with pages here has ip->pcached set. iget() drops
+// the pages of an inode before recycling its table entry, so a
+// file can only be written through the entry that has the flag.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 61
+
+struct pgent {
+  uint dev;
+  uint inum;          // 0: not (or no longer) a page of a file
+  uint off;           // offset of the page in the file
+  uint n;             // bytes from the file; the rest are zero
+  uint64 pa;          // the page, 0 if none
+  int ref;            // page tables mapping pa (slot free if 0 and no pa)
+  struct pgent *hnext;  // chain of keyhash(), if pa and inum
+  struct pgent *pnext;  // chain of pahash(), if pa
+  struct pgent *prev;   // LRU list, if ref is 0
+  struct pgent *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct pgent e[NPCACHE];
+  struct pgent *hash[NPCHASH];   // by (dev, inum, off)
+  struct pgent *phash[NPCHASH];  // by pa
+
+  // Entries nobody maps, through prev/next. head.next is the
+  // most recently used, head.prev the least (or an empty slot).
+  struct pgent head;
+} pcache;
+
+static struct pgent**
+keyhash(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[((dev * 31 + inum) * 31 + off / PGSIZE) % NPCHASH];
+}
+
+static struct pgent**
+pahash(uint64 pa)
+{
+  return &pcache.phash[(pa / PGSIZE) % NPCHASH];
+}
+
+// Take e off its keyhash() chain.
+static void
+keydel(struct pgent *e)
+{
+  struct pgent **pp;
+
+  for(pp = keyhash(e->dev, e->inum, e->off); *pp != e; pp = &(*pp)->hnext)
+    ;
+  *pp = e->hnext;
+}
+
+// Take e off its pahash() chain.
+static void
+padel(struct pgent *e)
+{
+  struct pgent **pp;
+
+  for(pp = pahash(e->pa); *pp != e; pp = &(*pp)->pnext)
+    ;
+  *pp = e->pnext;
+}
+
+// Put e on the LRU list: at the front if it holds a page, at
+// the back (reused first) if not.
+static void
+plru_add(struct pgent *e)
+{
+  struct pgent *at;
+
+  at = e->pa ? &pcache.head : pcache.head.prev;
+  e->next = at->next;
+  e->prev = at;
+  at->next->prev = e;
+  at->next = e;
+}
+
+static void
+plru_del(struct pgent *e)
+{
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+}
+
+// Free e's page, which nobody maps, leaving an empty slot
+// at the back of the LRU list.
+static void
+pfree(struct pgent *e)
+{
+  if(e->inum){
+    keydel(e);
+    e->inum = 0;
+  }
+  padel(e);
+  kfree((void*)e->pa);
+  e->pa = 0;
+  plru_del(e);
+  plru_add(e);
+}
+
+void
+pcacheinit(void)
+{
+  struct pgent *e;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.next = pcache.head.prev = &pcache.head;
+  for(e = pcache.e; e < pcache.e + NPCACHE; e++)
+    plru_add(e);
+}
+
+static struct pgent*
+pcache_find(uint64 pa)
+{
+  struct pgent *e;
+
+  for(e = *pahash(pa); e; e = e->pnext)
+    if(e->pa == pa)
+      return e;
+  panic("pcache: not a cached page");
+}
+
+// Return the page holding the n bytes of ip at off followed
+// by zeroes, with one more mapping counted, or 0 if it is
+// neither cached nor can be (no free slot or page).
+// Caller must hold ip->lock.
+uint64
+pcache_get(struct inode *ip, uint off, uint n)
+{
+  struct pgent *e;
+  char *mem;
+
+  acquire(&pcache.lock);
+  for(e = *keyhash(ip->dev, ip->inum, off); e; e = e->hnext){
+    if(e->inum == ip->inum && e->dev == ip->dev && e->off == off && e->n == n){
+      if(e->ref++ == 0)
+        plru_del(e);
+      release(&pcache.lock);
+      return e->pa;
+    }
+  }
+  // an empty slot, else the least recently used unmapped page
+  e = pcache.head.prev;
+  if(e == &pcache.head){
+    release(&pcache.lock);
+    return 0;
+  }
+  if(e->pa)
+    pfree(e);
+  // hold the slot (ref 1, no page yet) while the page is read.
+  // ip->lock keeps anyone else from looking for it meanwhile.
+  plru_del(e);
+  e->ref = 1;
+  release(&pcache.lock);
+
+  if((mem = kalloc()) != 0){
+    memset(mem, 0, PGSIZE);
+    if(readi(ip, 0, (uint64)mem, off, n) != n){
+      kfree(mem);
+      mem = 0;
+    }
+  }
+
+  acquire(&pcache.lock);
+  if(mem == 0){
+    e->ref = 0;
+    plru_add(e);
+    release(&pcache.lock);
+    return 0;
+  }
+  e->dev = ip->dev;
+  e->inum = ip->inum;
+  e->off = off;
+  e->n = n;
+  e->pa = (uint64)mem;
+  e->hnext = *keyhash(e->dev, e->inum, e->off);
+  *keyhash(e->dev, e->inum, e->off) = e;
+  e->pnext = *pahash(e->pa);
+  *pahash(e->pa) = e;
+  release(&pcache.lock);
+  ip->pcached = 1;
+  return (uint64)mem;
+}
+
+// One more page table maps pa.
+void
+pcache_dup(uint64 pa)
+{
+  acquire(&pcache.lock);
+  pcache_find(pa)->ref++;
+  release(&pcache.lock);
+}
+
+// A page table no longer maps pa.
+void
+pcache_put(uint64 pa)
+{
+  struct pgent *e;
+
+  acquire(&pcache.lock);
+  e = pcache_find(pa);
+  if(--e->ref == 0){
+    plru_add(e);
+    if(e->inum == 0)
+      pfree(e);  // dropped by pcache_inval() while mapped
+  }
+  release(&pcache.lock);
+}
+
+// The content of file (dev, inum) is changing: forget its pages.
+// Only writes to a program file get here, so scanning is fine.
+void
+pcache_inval(uint dev, uint inum)
+{
+  struct pgent *e;
+
+  acquire(&pcache.lock);
+  for(e = pcache.e; e < pcache.e + NPCACHE; e++){
+    if(e->pa == 0 || e->inum != inum || e->dev != dev)
+      continue;
+    if(e->ref == 0){
+      pfree(e);
+    } else {
+      keydel(e);
+      e->inum = 0;
+    }
+  }
+  release(&pcache.lock);
+}
@@ -7,16 +7,25 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+#define PIPESIZE 512          // default capacity, kept in data[]
+#define PIPEMAXPG 16          // largest capacity, in pages
 
+// A pipe is a ring of size bytes. The default ring is data[],
+// inside the page holding the struct; pipesize() can grow it
+// to a power-of-two number of separately allocated pages, so
+// that offsets stay consistent when nread/nwrite wrap around.
 struct pipe {
   struct spinlock lock;
   char data[PIPESIZE];
+  char *pg[PIPEMAXPG];  // ring pages when size > PIPESIZE
+  uint size;      // capacity in bytes
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int npoll;      // poll()s registered on this pipe
 };
 
 int
@@ -34,6 +43,8 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->npoll = 0;
+  pi->size = PIPESIZE;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -55,6 +66,18 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+// Free the ring pages of a pipe of the given size.
+static void
+pipefreepg(char **pg, uint size)
+{
+  int i;
+
+  if(size <= PIPESIZE)
+    return;
+  for(i = 0; i < size / PGSIZE; i++)
+    kfree(pg[i]);
+}
+
 void
 pipeclose(struct pipe *pi, int writable)
 {
@@ -66,17 +89,127 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  if(pi->npoll)
+    pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    pipefreepg(pi->pg, pi->size);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Return a pointer to ring byte off and trim *n to the
+// bytes that follow it contiguously in memory.
+static char*
+pipeptr(struct pipe *pi, uint off, int *n)
+{
+  uint o = off % pi->size;
+  int max;
+  char *p;
+
+  if(pi->size <= PIPESIZE){
+    p = pi->data + o;
+    max = pi->size - o;
+  } else {
+    p = pi->pg[o / PGSIZE] + o % PGSIZE;
+    max = PGSIZE - o % PGSIZE;
+  }
+  if(*n > max)
+    *n = max;
+  return p;
+}
+
+// Set the capacity of the pipe to at least n bytes, rounded up
+// to PIPESIZE or a power-of-two number of pages, keeping its
+// contents. n == 0 only reports the capacity.
+// Returns the capacity, or -1 if n is too large, smaller than
+// the data in the pipe, or out of memory.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  char *pg[PIPEMAXPG], *oldpg[PIPEMAXPG], *p;
+  uint size, oldsize, used, k;
+  int i, m;
+
+  if(n == 0)
+    return pi->size;
+  if(n < 0 || n > PIPEMAXPG * PGSIZE)
+    return -1;
+  for(size = PIPESIZE; size < n; size *= 2)
+    ;
+  if(size > PIPESIZE && size < PGSIZE)
+    size = PGSIZE;
+
+  for(i = 0; i < size / PGSIZE; i++){
+    if((pg[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(pg[i]);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  used = pi->nwrite - pi->nread;
+  if(size == pi->size || used > size){
+    n = (size == pi->size) ? size : -1;
+    release(&pi->lock);
+    pipefreepg(pg, size);
+    return n;
+  }
+  // copy the unread bytes to the start of the new ring
+  // (data[] when shrinking back to PIPESIZE).
+  for(k = 0; k < used; k += m){
+    m = used - k;
+    p = pipeptr(pi, pi->nread + k, &m);
+    if(size <= PIPESIZE)
+      memmove(pi->data + k, p, m);
+    else
+      memmove(pg[k / PGSIZE] + k % PGSIZE, p, m);
+  }
+  oldsize = pi->size;
+  memmove(oldpg, pi->pg, sizeof(oldpg));
+  memmove(pi->pg, pg, sizeof(pg));
+  pi->size = size;
+  pi->nread = 0;
+  pi->nwrite = used;
+  if(size > oldsize){
+    wakeup(&pi->nwrite);
+    if(pi->npoll)
+      pollwakeup();
+  }
+  release(&pi->lock);
+
+  pipefreepg(oldpg, oldsize);
+  return size;
+}
+// Readers sleep only while the pipe is empty and writers only
+// while it is full, so wakeups are sent only on the empty ->
+// non-empty and full -> non-full transitions.
+// Data moves in runs that stop at the end of a ring page and,
+// for user memory, at a user page boundary, so that a failed
+// copy leaves the bytes before it transferred.
+
+// Bring in the user page at va, which may mean reading the
+// program file and so sleeping: drops pi->lock meanwhile.
+static int
+pipefault(struct pipe *pi, struct proc *pr, uint64 va)
+{
+  int r;
+
+  release(&pi->lock);
+  r = vmfault(pr, va, 1);
+  acquire(&pi->lock);
+  return r;
+}
+
+// Write n bytes from addr, a user virtual address if user is
+// set, else a kernel address.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m;
+  char *p;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,29 +218,44 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+    if(pi->nwrite == pi->nread + pi->size){ //DOC: pipewrite-full
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      m = pi->nread + pi->size - pi->nwrite;
+      if(m > n - i)
+        m = n - i;
+      if(user && m > PGSIZE - (addr + i) % PGSIZE)
+        m = PGSIZE - (addr + i) % PGSIZE;
+      p = pipeptr(pi, pi->nwrite, &m);
+      if(either_copyin(p, user, addr + i, m) == -1){
+        // a page exec() has not loaded yet can only be
+        // brought in without the lock held.
+        if(!user || pipefault(pi, pr, addr + i) < 0)
+          break;
+        continue;
+      }
+      if(pi->nwrite == pi->nread){
+        wakeup(&pi->nread);
+        if(pi->npoll)
+          pollwakeup();
+      }
+      pi->nwrite += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
   release(&pi->lock);
 
   return i;
 }
 
+// Read up to n bytes into addr, a user virtual address if
+// user is set, else a kernel address.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user, uint64 addr, int n)
 {
-  int i;
+  int i, m;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,14 +265,53 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+    m = pi->nwrite - pi->nread;
+    if(m > n - i)
+      m = n - i;
+    if(user && m > PGSIZE - (addr + i) % PGSIZE)
+      m = PGSIZE - (addr + i) % PGSIZE;
+    p = pipeptr(pi, pi->nread, &m);
+    if(either_copyout(user, addr + i, p, m) == -1){
+      if(!user || pipefault(pi, pr, addr + i) < 0)
+        break;
+      m = 0;
+      continue;
+    }
+    if(pi->nwrite == pi->nread + pi->size){
+      wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+      if(pi->npoll)
+        pollwakeup();
+    }
+    pi->nread += m;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// What poll() would find on the read end of the pipe, or on
+// the write end if writable; reg registers (1) or drops (-1)
+// a poll that wants pollwakeup() calls for it.
+int
+pipepoll(struct pipe *pi, int writable, int reg)
+{
+  int ev = 0;
+
+  acquire(&pi->lock);
+  pi->npoll += reg;
+  if(writable){
+    if(pi->readopen == 0)
+      ev |= POLLERR;
+    else if(pi->nwrite != pi->nread + pi->size)
+      ev |= POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      ev |= POLLIN;
+    if(pi->writeopen == 0)
+      ev |= POLLHUP;
+  }
+  release(&pi->lock);
+  return ev;
+}
@@ -0,0 +1,101 @@
+// poll(): wait for any of several files to become ready.
+//
+// Pipes and the console count the polls registered on them
+// (filepoll() with reg = 1 / -1) and, only while there are
+// some, call pollwakeup() whenever they may have become ready:
+// when data arrives, space frees up, or an end is closed.
+// pollwakeup() bumps a sequence number and wakes every poller;
+// a poller sleeps only if the number has not moved since it
+// last looked at its files, so no change can slip in between.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+
+struct {
+  struct spinlock lock;
+  uint seq;         // pollwakeup() calls so far
+} pollq;
+
+void
+pollinit(void)
+{
+  initlock(&pollq.lock, "poll");
+}
+
+// Something a poll may be waiting for happened.
+void
+pollwakeup(void)
+{
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// register (reg 1) or drop (reg -1) the polls on fds, or just
+// fill in revents (reg 0). returns the entries with revents set.
+static int
+pollscan(struct pollfd *fds, int nfds, int reg)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < nfds; i++){
+    if(fds[i].fd < 0 || fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0)
+      fds[i].revents = POLLNVAL;
+    else
+      fds[i].revents = filepoll(f, reg) & (fds[i].events | POLLERR | POLLHUP);
+    if(fds[i].revents)
+      n++;
+  }
+  return n;
+}
+
+// Wait until one of fds is ready, or timeout ticks have passed
+// (never if timeout is negative). Returns how many are ready,
+// 0 on timeout, -1 if killed.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+  uint seq, deadline;
+  int n, r;
+
+  deadline = ticks + timeout;
+  pollscan(fds, nfds, 1);
+  for(;;){
+    acquire(&pollq.lock);
+    seq = pollq.seq;
+    release(&pollq.lock);
+
+    if((n = pollscan(fds, nfds, 0)) > 0 || timeout == 0)
+      break;
+    if(killed(myproc())){
+      n = -1;
+      break;
+    }
+
+    r = 0;
+    acquire(&pollq.lock);
+    if(pollq.seq == seq){
+      if(timeout < 0)
+        sleep(&pollq, &pollq.lock);
+      else
+        r = sleepuntil(&pollq, &pollq.lock, deadline);
+    }
+    release(&pollq.lock);
+    if(r < 0)
+      break;
+  }
+  pollscan(fds, nfds, -1);
+  return n;
+}
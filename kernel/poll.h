@@ -0,0 +1,12 @@
+// poll() requests and results.
+struct pollfd {
+  int fd;
+  short events;     // what to wait for
+  short revents;    // what happened
+};
+
+#define POLLIN    0x001   // can read without blocking
+#define POLLOUT   0x004   // can write without blocking
+#define POLLERR   0x008   // write end of a pipe with no reader
+#define POLLHUP   0x010   // read end of a pipe with no writer
+#define POLLNVAL  0x020   // fd is not open
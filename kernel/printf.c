@@ -1,6 +1,14 @@
 //
 // formatted console output -- printf, panic.
 //
+// printf() formats into a log ring private to the calling CPU,
+// with interrupts off and no lock, so CPUs printing at the same
+// time never wait for each other or for the UART. klogdrain(),
+// run from every CPU's timer interrupt, moves what the rings
+// hold to a shared history ring and from there to the UART's
+// transmit buffer, as far as it has room. dmesg() reads the
+// history back. panic() stops all this and prints synchronously.
+//
 
 #include <stdarg.h>
 
@@ -17,16 +25,44 @@
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
+#define KLOG_SIZE 1024    // per-CPU ring
+#define KLOG_HIST 8192    // history ring, what dmesg() sees
+
+// written only by its own CPU, with interrupts off.
+// read by klogdrain() up to the published w.
+struct klog {
+  char buf[KLOG_SIZE];
+  uint64 w;               // end of the last complete printf()
+  uint64 d;               // drained up to here (klogdrain() only)
+};
+
 static struct {
-  struct spinlock lock;
-  int locking;
+  int async;              // 0: print synchronously (boot, panic)
+  struct klog cpu[NCPU];
+
+  struct spinlock lock;   // the history and the drain
+  char hist[KLOG_HIST];
+  uint64 hw;              // written to the history
+  uint64 hu;              // handed to the UART
 } pr;
 
+// put c where the current printf() goes: l's ring, or the
+// UART when l is 0. *w is the ring position not yet published.
+static void
+logputc(struct klog *l, uint64 *w, int c)
+{
+  if(l == 0){
+    consputc(c);
+    return;
+  }
+  l->buf[*w % KLOG_SIZE] = c;
+  *w += 1;
+}
+
 static char digits[] = "0123456789abcdef";
 
 static void
-printint(long long xx, int base, int sign)
+printint(struct klog *l, uint64 *w, long long xx, int base, int sign)
 {
   char buf[16];
   int i;
@@ -46,17 +82,17 @@ printint(long long xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    logputc(l, w, buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(struct klog *l, uint64 *w, uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  logputc(l, w, '0');
+  logputc(l, w, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    logputc(l, w, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console.
@@ -64,17 +100,19 @@ int
 printf(char *fmt, ...)
 {
   va_list ap;
-  int i, cx, c0, c1, c2, locking;
+  int i, cx, c0, c1, c2;
   char *s;
+  struct klog *l;
+  uint64 w;
 
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
+  push_off();
+  l = pr.async ? &pr.cpu[cpuid()] : 0;
+  w = l ? l->w : 0;
 
   va_start(ap, fmt);
   for(i = 0; (cx = fmt[i] & 0xff) != 0; i++){
     if(cx != '%'){
-      consputc(cx);
+      logputc(l, &w, cx);
       continue;
     }
     i++;
@@ -83,44 +121,44 @@ printf(char *fmt, ...)
     if(c0) c1 = fmt[i+1] & 0xff;
     if(c1) c2 = fmt[i+2] & 0xff;
     if(c0 == 'd'){
-      printint(va_arg(ap, int), 10, 1);
+      printint(l, &w, va_arg(ap, int), 10, 1);
     } else if(c0 == 'l' && c1 == 'd'){
-      printint(va_arg(ap, uint64), 10, 1);
+      printint(l, &w, va_arg(ap, uint64), 10, 1);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-      printint(va_arg(ap, uint64), 10, 1);
+      printint(l, &w, va_arg(ap, uint64), 10, 1);
       i += 2;
     } else if(c0 == 'u'){
-      printint(va_arg(ap, int), 10, 0);
+      printint(l, &w, va_arg(ap, int), 10, 0);
     } else if(c0 == 'l' && c1 == 'u'){
-      printint(va_arg(ap, uint64), 10, 0);
+      printint(l, &w, va_arg(ap, uint64), 10, 0);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-      printint(va_arg(ap, uint64), 10, 0);
+      printint(l, &w, va_arg(ap, uint64), 10, 0);
       i += 2;
     } else if(c0 == 'x'){
-      printint(va_arg(ap, int), 16, 0);
+      printint(l, &w, va_arg(ap, int), 16, 0);
     } else if(c0 == 'l' && c1 == 'x'){
-      printint(va_arg(ap, uint64), 16, 0);
+      printint(l, &w, va_arg(ap, uint64), 16, 0);
       i += 1;
     } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-      printint(va_arg(ap, uint64), 16, 0);
+      printint(l, &w, va_arg(ap, uint64), 16, 0);
       i += 2;
     } else if(c0 == 'p'){
-      printptr(va_arg(ap, uint64));
+      printptr(l, &w, va_arg(ap, uint64));
     } else if(c0 == 's'){
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        logputc(l, &w, *s);
     } else if(c0 == '%'){
-      consputc('%');
+      logputc(l, &w, '%');
     } else if(c0 == 0){
       break;
     } else {
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c0);
+      logputc(l, &w, '%');
+      logputc(l, &w, c0);
     }
 
 #if 0
@@ -153,16 +191,112 @@ printf(char *fmt, ...)
   }
   va_end(ap);
 
-  if(locking)
-    release(&pr.lock);
+  if(l){
+    // publish the whole message at once.
+    __sync_synchronize();
+    l->w = w;
+  }
+  pop_off();
 
   return 0;
 }
 
+// copy from a ring of size n at absolute position p.
+static void
+ringcopy(char *dst, char *ring, int n, uint64 p, int len)
+{
+  while(len-- > 0)
+    *dst++ = ring[p++ % n];
+}
+
+// move what the CPU rings hold to the history, and from the
+// history as much as fits to the UART. never sleeps.
+void
+klogdrain(void)
+{
+  struct klog *l;
+  char buf[64];
+  uint64 w;
+  int n;
+
+  if(!pr.async || panicked)
+    return;
+
+  acquire(&pr.lock);
+  for(l = pr.cpu; l < pr.cpu + NCPU; l++){
+    w = l->w;
+    __sync_synchronize();
+    if(w - l->d > KLOG_SIZE)
+      l->d = w - KLOG_SIZE;   // overrun: the oldest output is lost
+    for(; l->d < w; l->d++)
+      pr.hist[pr.hw++ % KLOG_HIST] = l->buf[l->d % KLOG_SIZE];
+  }
+  if(pr.hw - pr.hu > KLOG_HIST)
+    pr.hu = pr.hw - KLOG_HIST;
+  while(pr.hu < pr.hw){
+    n = pr.hw - pr.hu;
+    if(n > sizeof(buf))
+      n = sizeof(buf);
+    ringcopy(buf, pr.hist, KLOG_HIST, pr.hu, n);
+    n = uartwrite_nowait(buf, n);
+    if(n == 0)
+      break;                  // UART buffer full; next tick
+    pr.hu += n;
+  }
+  release(&pr.lock);
+}
+
+// copy up to n of the most recent bytes of kernel output to
+// user address dst. returns how many, or -1.
+int
+dmesg(uint64 dst, int n)
+{
+  char buf[128];
+  uint64 p, end;
+  int m, done;
+
+  klogdrain();
+
+  acquire(&pr.lock);
+  end = pr.hw;
+  p = end > KLOG_HIST ? end - KLOG_HIST : 0;
+  if(end - p > n)
+    p = end - n;
+  release(&pr.lock);
+
+  // copyout() may fault, so copy in pieces without the lock.
+  for(done = 0; p < end; p += m, done += m){
+    m = end - p;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    acquire(&pr.lock);
+    if(pr.hw > KLOG_HIST && p < pr.hw - KLOG_HIST){
+      // overwritten meanwhile: skip ahead.
+      m = pr.hw - KLOG_HIST - p;
+      release(&pr.lock);
+      done -= m;
+      continue;
+    }
+    ringcopy(buf, pr.hist, KLOG_HIST, p, m);
+    release(&pr.lock);
+    if(copyout(myproc()->pagetable, dst + done, buf, m) < 0)
+      return -1;
+  }
+  return done;
+}
+
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  struct klog *l;
+
+  // print synchronously from now on, starting with what the
+  // rings still hold so the messages leading here are not lost.
+  pr.async = 0;
+  for(l = pr.cpu; l < pr.cpu + NCPU; l++)
+    for(; l->d < l->w; l->d++)
+      if(l->w - l->d <= KLOG_SIZE)
+        consputc(l->buf[l->d % KLOG_SIZE]);
   printf("panic: ");
   printf("%s\n", s);
   panicked = 1; // freeze uart output from other CPUs
@@ -174,5 +308,5 @@ void
 printfinit(void)
 {
   initlock(&pr.lock, "pr");
-  pr.locking = 1;
+  pr.async = 1;
 }
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
 
 struct cpu cpus[NCPU];
 
@@ -150,6 +151,15 @@ found:
     return 0;
   }
 
+  // and the page the process reads its own pid from.
+  if((p->uproc = (struct uproc *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->uproc, 0, PGSIZE);
+  p->uproc->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -177,9 +187,13 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->uproc)
+    kfree((void*)p->uproc);
+  p->uproc = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  p->ring = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -189,6 +203,8 @@ freeproc(struct proc *p)
   p->xstate = 0;
   p->priority = 0;
   p->creation_time = 0;
+  p->tc_pt = 0;
+  p->nseg = 0;
   p->state = UNUSED;
 }
 
@@ -223,6 +239,24 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // and below it the pages user code reads ticks and its
+  // pid from (vdso.h), read-only.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)vdso, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, UPROC, PGSIZE,
+              (uint64)(p->uproc), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, VDSO, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -233,6 +267,10 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
+  uvmunmap(pagetable, UPROC, 1, 0);
+  if(walkaddr(pagetable, URING))
+    uvmunmap(pagetable, URING, 1, 1);
   uvmfree(pagetable, sz);
 }
 
@@ -275,6 +313,36 @@ userinit(void)
   release(&p->lock);
 }
 
+// A kernel process's very first scheduling by scheduler()
+// will swtch here instead of to forkret.
+static void
+kprocstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn();
+  panic("kproc returned");
+}
+
+// Start a process that runs fn() in the kernel and never
+// returns to user space, for daemons like the log flusher.
+// It has no parent and fn() must not return.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  p->kfn = fn;
+  p->context.ra = (uint64)kprocstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -331,6 +399,12 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->exe){
+    np->exe = idup(p->exe);
+    iexec(np->exe, 1);
+  }
+  np->nseg = p->nseg;
+  memmove(np->seg, p->seg, sizeof(p->seg));
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -349,6 +423,54 @@ fork(void)
   return pid;
 }
 
+// Create a child running the program in path, as fork()
+// followed by exec() in the child would, but without copying
+// the parent's memory. The child's fd i is the parent's fd
+// fdmap[i] (none if -1) for i < nfd, and it has no others;
+// with nfd < 0 it gets all the parent's fds, as after fork().
+int
+spawn(char *path, char **argv, int *fdmap, int nfd)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  // kexec() sleeps; np is USED, so nothing else touches it.
+  release(&np->lock);
+
+  np->priority = p->priority;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = kexec(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < NOFILE; i++){
+    if(nfd < 0 && p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+    else if(i < nfd && fdmap[i] >= 0)
+      np->ofile[i] = filedup(p->ofile[fdmap[i]]);
+  }
+  np->cwd = idup(p->cwd);
+
+  pid = np->pid;
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -386,8 +508,13 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe){
+    iexec(p->exe, -1);
+    iput(p->exe);
+  }
   end_op();
   p->cwd = 0;
+  p->exe = 0;
 
   acquire(&wait_lock);
 
@@ -418,6 +545,11 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the copyout below holds spin-locks, so it cannot bring in
+  // a page of the program file; do that first.
+  if(addr != 0)
+    vmprefault(addr, sizeof(int));
+
   acquire(&wait_lock);
 
   for(;;){
@@ -601,6 +733,66 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// earliest deadline of the processes in sleepuntil(),
+// or later; clockintr() looks at the table only once it passes.
+static uint nextdeadline = ~0;
+
+// Like sleep(), but also wake up once ticks reaches deadline.
+// Returns -1 if it has, 0 otherwise (a wakeup on chan, or kill).
+int
+sleepuntil(void *chan, struct spinlock *lk, uint deadline)
+{
+  struct proc *p = myproc();
+  uint old;
+
+  if(ticks >= deadline)
+    return -1;
+
+  acquire(&p->lock);
+  release(lk);
+
+  p->chan = chan;
+  p->deadline = deadline;
+  while((old = nextdeadline) > deadline &&
+        !__sync_bool_compare_and_swap(&nextdeadline, old, deadline))
+    ;
+  p->state = SLEEPING;
+
+  sched();
+
+  p->chan = 0;
+  p->deadline = 0;
+
+  release(&p->lock);
+  acquire(lk);
+  return ticks >= deadline ? -1 : 0;
+}
+
+// Called by clockintr() each tick: wake up the processes in
+// sleepuntil() whose deadline has come.
+void
+wakedeadlines(void)
+{
+  struct proc *p;
+  uint old;
+
+  if(ticks < nextdeadline)
+    return;
+  nextdeadline = ~0;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->deadline){
+      if(ticks >= p->deadline)
+        p->state = RUNNABLE;
+      else
+        while((old = nextdeadline) > p->deadline &&
+              !__sync_bool_compare_and_swap(&nextdeadline, old, p->deadline))
+          ;
+    }
+    release(&p->lock);
+  }
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
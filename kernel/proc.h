@@ -79,17 +79,38 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 kernel_fasttrap; // usertrapfast()
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// Cursor for a run of copies to/from user memory (vm.c).
+struct ucursor {
+  pagetable_t pagetable;
+  uint64 va;     // next user address
+  uint64 pgva;   // page translated in pa
+  uint64 pa;     // physical address of pgva, or 0
+};
+
+// An ELF segment exec() left to be loaded on first use (vmfault()).
+struct vmseg {
+  uint64 va;      // first address, page aligned
+  uint64 filesz;  // bytes that come from the file
+  uint64 memsz;   // bytes in memory; the rest are zero
+  uint off;       // offset of va in the file
+  int perm;       // PTE_X, PTE_W
+};
+
+#define NVMSEG 4
+
 struct proc {
   struct spinlock lock;
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  uint deadline;               // If non-zero, tick sleepuntil() gives up at
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
@@ -102,7 +123,11 @@ struct proc {
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
+  struct uproc *uproc;         // mapped read-only at UPROC
+  struct ring *ring;           // mapped at URING, or 0
   struct context context;      // swtch() here to run process
+  void (*kfn)(void);           // kernel process body (see kproc())
+  int nsleeplk;                // sleep-locks held (see vmfault())
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
@@ -111,5 +136,17 @@ struct proc {
   int priority; // -20 (highest priority) to 19 (lowest priority)
   int creation_time; // el tiempo de creacion del proceso
 
+  // last user page translated by copyin/copyout (see vm.c)
+  pagetable_t tc_pt;
+  uint64 tc_va;
+  uint64 tc_pa;
+  uint64 tc_gen;
+  int tc_w;
+
+  // program file and the segments still loaded from it
+  struct inode *exe;
+  int nseg;
+  struct vmseg seg[NVMSEG];
+
 
 };
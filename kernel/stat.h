@@ -9,3 +9,14 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// File system cache counters, returned by fsstat().
+struct fsstat {
+  uint ninode;   // i-nodes in the in-memory table
+  uint iactive;  // of those, referenced
+  uint ihits;    // iget() found the i-node in the table
+  uint imisses;  // iget() had to take a new entry
+  uint ireads;   // ilock() read the dinode from disk
+  uint dhits;    // name cache hits
+  uint dmisses;  // name cache misses
+};
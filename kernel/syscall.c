@@ -111,6 +111,21 @@ extern uint64 sys_setscheduler(void);
 extern uint64 sys_term_raw(void);
 extern uint64 sys_term_cooked(void);
 extern uint64 sys_term_available(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_logmode(void);
+extern uint64 sys_pipesize(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_fsstat(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_dmesg(void);
+extern uint64 sys_term_timeout(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_ring_setup(void);
+extern uint64 sys_ring_enter(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -146,6 +161,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_term_raw]    sys_term_raw,
 [SYS_term_cooked] sys_term_cooked,
 [SYS_term_available] sys_term_available,
+[SYS_fsync]   sys_fsync,
+[SYS_logmode] sys_logmode,
+[SYS_pipesize] sys_pipesize,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_fsstat]  sys_fsstat,
+[SYS_spawn]   sys_spawn,
+[SYS_dmesg]   sys_dmesg,
+[SYS_term_timeout] sys_term_timeout,
+[SYS_poll]    sys_poll,
+[SYS_ring_setup] sys_ring_setup,
+[SYS_ring_enter] sys_ring_enter,
 };
 
 void
@@ -165,3 +195,25 @@ syscall(void)
     p->trapframe->a0 = -1;
   }
 }
+
+// Run system call num with arguments a0..a2 for the current
+// process, as if it had trapped with them in its registers.
+// Used by ring_enter() (uring.c) for batched calls.
+uint64
+syscall_as(int num, uint64 a0, uint64 a1, uint64 a2)
+{
+  struct trapframe *tf = myproc()->trapframe;
+  uint64 s0, s1, s2, r;
+
+  s0 = tf->a0;
+  s1 = tf->a1;
+  s2 = tf->a2;
+  tf->a0 = a0;
+  tf->a1 = a1;
+  tf->a2 = a2;
+  r = syscalls[num]();
+  tf->a0 = s0;
+  tf->a1 = s1;
+  tf->a2 = s2;
+  return r;
+}
@@ -29,4 +29,26 @@
 #define SYS_setscheduler 27
 #define SYS_term_raw     28
 #define SYS_term_cooked  29
-#define SYS_term_available 30
\ No newline at end of file
+#define SYS_term_available 30
+#define SYS_fsync   31
+#define SYS_logmode 32
+#define SYS_pipesize 33
+#define SYS_splice  34
+#define SYS_readv   35
+#define SYS_writev  36
+#define SYS_pread   37
+#define SYS_pwrite  38
+#define SYS_fsstat  39
+#define SYS_spawn   40
+#define SYS_dmesg   41
+#define SYS_term_timeout 42
+#define SYS_poll    43
+#define SYS_ring_setup 44
+#define SYS_ring_enter 45
+
+// System calls uservec runs on its fast path (see trampoline.S):
+// they never sleep, fault or give up the CPU, so they run as a
+// plain C call with only the caller-saved registers stored.
+#define FASTSYSCALLS ((1<<SYS_getpid) | (1<<SYS_uptime) | \
+                      (1<<SYS_freemem) | (1<<SYS_pagesize) | \
+                      (1<<SYS_getpriority) | (1<<SYS_term_available))
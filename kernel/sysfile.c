@@ -14,7 +14,9 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 #include "fcntl.h"
+#include "poll.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -189,7 +191,6 @@ uint64
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], path[MAXPATH];
   uint off;
 
@@ -219,9 +220,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -341,6 +340,14 @@ sys_open(void)
     return -1;
   }
 
+  //un programa que algun proceso esta ejecutando no se puede
+  //abrir para escribir ni truncar (ver iexec())
+  if(ip->nexec > 0 && (omode & (O_WRONLY | O_RDWR | O_TRUNC))){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
@@ -431,47 +438,95 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Copy the user argv array at uargv, and the strings it
+// points to, into argv[MAXARG]. The strings go in kalloc()ed
+// pages, which freeargv() gives back.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
+  struct proc *p = myproc();
+  struct ucursor uc;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
+  // the argv array is read through one cursor, not a
+  // page-table walk per pointer.
+  ucinit(&uc, p->pagetable, uargv);
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
-    }
-    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+    if(i >= MAXARG)
+      return -1;
+    if(uargv >= p->sz || uargv+sizeof(uint64)*(i+1) > p->sz ||
+       ucin(&uc, &uarg, sizeof(uarg)) < 0){
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+}
 
-  int ret = exec(path, argv);
+static void
+freeargv(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
 
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+//spawn(path, argv, fdmap, nfd): crea un hijo que ejecuta path, como fork+exec
+//sin copiar la memoria del padre; el fd i del hijo es el fd fdmap[i] del padre
+//(-1 = cerrado) para i < nfd, y no tiene mas; con nfd < 0 los hereda todos
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int fdmap[NOFILE], nfd, i, ret;
+  uint64 uargv, ufdmap;
+  struct proc *p = myproc();
+
+  argaddr(1, &uargv);
+  argaddr(2, &ufdmap);
+  argint(3, &nfd);
+  if(argstr(0, path, MAXPATH) < 0 || nfd > NOFILE)
+    return -1;
+  if(nfd > 0 && copyin(p->pagetable, (char*)fdmap, ufdmap, nfd*sizeof(int)) < 0)
+    return -1;
+  for(i = 0; i < nfd; i++){
+    if(fdmap[i] < -1 || fdmap[i] >= NOFILE ||
+       (fdmap[i] >= 0 && p->ofile[fdmap[i]] == 0))
+      return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = spawn(path, argv, fdmap, nfd);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -503,3 +558,212 @@ sys_pipe(void)
   }
   return 0;
 }
+
+//fuerza el commit del log para que todo lo escrito hasta ahora sea
+//duradero (en modo asincrono end_op() puede dejar el grupo pendiente)
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE && f->type != FD_DEVICE)
+    return -1;
+
+  log_force();
+  return 0;
+}
+
+//cambia el modo del log (bits de fs.h): LOG_ASYNC = group commit asincrono,
+//LOG_ORDERED = los datos de los ficheros no pasan por el log
+//devuelve el modo anterior
+uint64
+sys_logmode(void)
+{
+  int mode;
+
+  argint(0, &mode);
+  if(mode < 0 || mode > (LOG_ASYNC | LOG_ORDERED))
+    return -1;
+
+  return log_setmode(mode);
+}
+
+//cambia la capacidad del pipe fd a al menos n bytes (0 solo la consulta)
+//devuelve la capacidad resultante
+uint64
+sys_pipesize(void)
+{
+  struct file *f;
+  int n;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  argint(1, &n);
+  if(f->type != FD_PIPE)
+    return -1;
+
+  return pipesetsize(f->pipe, n);
+}
+
+//mueve hasta n bytes entre un pipe y un fichero (en cualquier sentido)
+//sin pasar por memoria de usuario; devuelve los bytes movidos
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0)
+    return -1;
+  argint(2, &n);
+
+  return filesplice(in, out, n);
+}
+
+//copia del usuario el vector de cnt iovec que hay en el argumento 1
+//comprobando que la suma de longitudes cabe en un int
+static int
+argiov(struct iovec *iov, int *cnt)
+{
+  uint64 uiov, tot;
+  int i;
+
+  argaddr(1, &uiov);
+  argint(2, cnt);
+  if(*cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, *cnt * sizeof(struct iovec)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < *cnt; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+//lectura dispersa: readv(fd, iov, cnt), con un solo ilock en ficheros
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt) < 0)
+    return -1;
+
+  return filereadv(f, iov, cnt, -1);
+}
+
+//escritura agrupada: writev(fd, iov, cnt), en una sola transaccion
+//del log si cabe
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt) < 0)
+    return -1;
+
+  return filewritev(f, iov, cnt, -1);
+}
+
+//pread(fd, buf, n, off): lee en el offset off sin mover el del fichero
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  uint64 p;
+  int n, off;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0 || off < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+
+  return filereadv(f, &iov, 1, off);
+}
+
+//pwrite(fd, buf, n, off): escribe en el offset off sin mover el del fichero
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  uint64 p;
+  int n, off;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0 || off < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+
+  return filewritev(f, &iov, 1, off);
+}
+
+//fsstat(st): copia en st los contadores de la cache de inodos y de nombres
+uint64
+sys_fsstat(void)
+{
+  struct fsstat st;
+  uint64 p;
+
+  argaddr(0, &p);
+  fsstat(&st);
+  if(copyout(myproc()->pagetable, p, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+//poll(fds, nfds, timeout): espera a que alguno de los nfds descriptores
+//este listo para lo que pide su events, o timeout ticks (siempre si es
+//negativo); rellena revents y devuelve cuantos lo estan, 0 si vencio
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  uint64 p;
+  int nfds, timeout, n;
+
+  argaddr(0, &p);
+  argint(1, &nfds);
+  argint(2, &timeout);
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)fds, p, nfds * sizeof(fds[0])) < 0)
+    return -1;
+  if((n = poll(fds, nfds, timeout)) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, p, (char*)fds, nfds * sizeof(fds[0])) < 0)
+    return -1;
+  return n;
+}
+
+//ring_setup(): mapea (una vez) la pagina de llamadas en lote de kernel/uring.h
+//y devuelve su direccion
+uint64
+sys_ring_setup(void)
+{
+  return ring_setup();
+}
+
+//ring_enter(): ejecuta de una vez las entradas encoladas en el anillo y deja
+//una respuesta por cada una; devuelve cuantas ejecuto
+uint64
+sys_ring_enter(void)
+{
+  return ring_enter();
+}
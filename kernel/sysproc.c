@@ -268,3 +268,26 @@ uint64 sys_term_available(void)
   return console_available();
 }
 
+//en modo crudo, read espera vmin bytes o vtime ticks (ver consolereadraw)
+uint64 sys_term_timeout(void)
+{
+  int vmin, vtime;
+
+  argint(0, &vmin);
+  argint(1, &vtime);
+  return console_set_timeout(vmin, vtime);
+}
+
+//copia en buf los ultimos n bytes (como mucho) que ha escrito el kernel
+//con printf, aunque ya hayan salido por la consola
+uint64 sys_dmesg(void)
+{
+  uint64 buf;
+  int n;
+
+  argaddr(0, &buf);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return dmesg(buf, n);
+}
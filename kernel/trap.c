@@ -5,9 +5,11 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
 
 struct spinlock tickslock;
 uint ticks;
+struct vdso *vdso;    // mapped read-only at VDSO in every process
 
 extern char trampoline[], uservec[], userret[];
 
@@ -22,6 +24,12 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+
+  if((vdso = (struct vdso*)kalloc()) == 0)
+    panic("trapinit: vdso");
+  memset(vdso, 0, PGSIZE);
+  vdso->ticklen = 1000000;     // see clockintr()
+  vdso->timefreq = 10000000;   // qemu's virt machine: 10 MHz
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -73,18 +81,21 @@ usertrap(void)
   } else if((which_dev = devintr()) != 0){
     // external / timer interrupt: ok, ya lo ha manejado devintr().
 
-  } else if(scause == 13 || scause == 15){
+  } else if(scause == 12 || scause == 13 || scause == 15){
+    // 12: instruction page fault
     // 13: load page fault
     // 15: store/AMO page fault
 
     uint64 stval = r_stval(); // VA que causó el fallo
 
-    if(lazy_alloc(stval, p) < 0){
-      // lazy_alloc ya puede haber marcado p->killed si es fuera de rango.
-      printf("usertrap: lazy_alloc failed va=0x%lx pid=%d\n",
+    // páginas del programa que exec aún no ha cargado, o del heap perezoso
+    intr_on();
+    if(vmfault(p, stval, 1) < 0){
+      printf("usertrap: page fault va=0x%lx pid=%d\n",
              stval, p->pid);
       // No hacemos exit aquí directamente: dejamos que el bloque
       // de más abajo vea killed(p) y haga exit().
+      setkilled(p);
     }
 
   } else {
@@ -108,6 +119,28 @@ usertrap(void)
 }
 
 
+//
+// system calls in FASTSYSCALLS (syscall.h) come here from
+// fastvec in trampoline.S: a plain C call on the kernel stack,
+// with interrupts off and only the caller-saved user registers
+// in the trapframe. no killed() check or yield(); a timer
+// interrupt takes care of those soon enough.
+// returns the user page table for fastvec to switch back to.
+//
+uint64
+usertrapfast(void)
+{
+  struct proc *p = myproc();
+
+  w_stvec((uint64)kernelvec);
+
+  syscall();
+  w_sepc(r_sepc() + 4);
+
+  w_stvec(TRAMPOLINE + (uservec - trampoline));
+  return MAKE_SATP(p->pagetable);
+}
+
 //
 // return to user space
 //
@@ -130,7 +163,9 @@ usertrapret(void)
   p->trapframe->kernel_satp = r_satp();         // kernel page table
   p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
+  p->trapframe->kernel_fasttrap = (uint64)usertrapfast;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
+  p->uproc->cpu = r_tp();
 
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
@@ -194,7 +229,9 @@ clockintr()
   if(cpuid() == 0){
     acquire(&tickslock);
     ticks++;
+    vdso->ticks = ticks;
     wakeup(&ticks);
+    wakedeadlines();
     release(&tickslock);
   }
 
@@ -238,6 +275,7 @@ devintr()
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
     clockintr();
+    klogdrain();
     return 2;
   } else {
     return 0;
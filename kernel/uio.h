@@ -0,0 +1,7 @@
+// I/O vector for readv() and writev().
+struct iovec {
+  void *iov_base;   // buffer (user address)
+  uint64 iov_len;   // its length in bytes
+};
+
+#define IOV_MAX 16  // max entries in one readv()/writev()
@@ -0,0 +1,94 @@
+// Batched system calls.
+//
+// ring_setup() maps a page shared by the process and the kernel
+// at URING (memlayout.h), holding a submission and a completion
+// queue (uring.h). The process queues open/read/write/close/fstat
+// entries there and calls ring_enter(), which runs all of them,
+// in order, in that single trap, posting a completion for each.
+// Entries run through the ordinary system call functions
+// (syscall_as()), so each one behaves exactly like its call.
+//
+// An entry with RING_LASTFD uses the fd the batch's last
+// RING_OPEN returned, so open, fstat, read and close of a file
+// can go in one batch. If that open failed, the entry fails too.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "syscall.h"
+#include "uring.h"
+
+// Map the ring page if the process has none yet.
+// Returns its user address, or -1.
+uint64
+ring_setup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(p->ring)
+    return URING;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)mem,
+              PTE_R | PTE_W | PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->ring = (struct ring*)mem;
+  return URING;
+}
+
+// Run the queued entries, as many as there is room for
+// completions. Returns how many ran, or -1.
+int
+ring_enter(void)
+{
+  static int sysno[] = {
+    [RING_OPEN]  SYS_open,
+    [RING_READ]  SYS_read,
+    [RING_WRITE] SYS_write,
+    [RING_CLOSE] SYS_close,
+    [RING_FSTAT] SYS_fstat,
+  };
+  struct proc *p = myproc();
+  struct ring *r = p->ring;
+  struct ring_sqe e;
+  struct ring_cqe *c;
+  int n, fd, res, lastfd;
+
+  if(r == 0 || r->sq_tail - r->sq_head > RING_ENTRIES)
+    return -1;
+
+  lastfd = -1;
+  for(n = 0; r->sq_head != r->sq_tail; n++){
+    if(r->cq_tail - r->cq_head >= RING_ENTRIES || killed(p))
+      break;
+    // the process may rewrite the slot; work on a copy.
+    e = r->sq[r->sq_head % RING_ENTRIES];
+    r->sq_head++;
+
+    fd = (e.flags & RING_LASTFD) ? lastfd : e.fd;
+    if(e.op == RING_NOP)
+      res = 0;
+    else if(e.op < 0 || e.op >= NELEM(sysno) || sysno[e.op] == 0)
+      res = -1;
+    else if(e.op == RING_OPEN)
+      res = lastfd = syscall_as(SYS_open, e.addr, e.len, 0);
+    else if((e.flags & RING_LASTFD) && lastfd < 0)
+      res = -1;
+    else
+      res = syscall_as(sysno[e.op], fd, e.addr, e.len);
+
+    c = &r->cq[r->cq_tail % RING_ENTRIES];
+    c->data = e.data;
+    c->res = res;
+    r->cq_tail++;
+  }
+  return n;
+}
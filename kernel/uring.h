@@ -0,0 +1,43 @@
+// Batched system calls: the page ring_setup() maps at URING.
+// The process adds entries at sq[sq_tail], then calls
+// ring_enter(); the kernel runs them in order from sq_head and
+// posts one completion for each at cq[cq_tail]. The process
+// consumes completions from cq_head. Indices only grow; the
+// slot is the index modulo RING_ENTRIES.
+
+#define RING_ENTRIES 64
+
+// operations, each like the system call of the same name.
+#define RING_NOP    0
+#define RING_OPEN   1     // addr: path, len: flags
+#define RING_READ   2     // fd, addr, len
+#define RING_WRITE  3     // fd, addr, len
+#define RING_CLOSE  4     // fd
+#define RING_FSTAT  5     // fd, addr: struct stat
+
+// flags
+#define RING_LASTFD 0x1   // use the fd of the batch's last RING_OPEN
+
+struct ring_sqe {
+  int op;
+  int flags;
+  int fd;
+  int len;
+  uint64 addr;
+  uint64 data;      // copied to the completion
+};
+
+struct ring_cqe {
+  uint64 data;
+  int res;          // what the system call would have returned
+  int pad;
+};
+
+struct ring {
+  uint sq_head;     // next entry the kernel runs
+  uint sq_tail;     // next entry the process fills in
+  uint cq_head;     // next completion the process reads
+  uint cq_tail;     // next completion the kernel posts
+  struct ring_sqe sq[RING_ENTRIES];
+  struct ring_cqe cq[RING_ENTRIES];
+};
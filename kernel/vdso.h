@@ -0,0 +1,16 @@
+// Pages the kernel maps read-only into every user address
+// space, below the trapframe (see memlayout.h), so that a
+// process can read them without a system call.
+
+// at VDSO: one page, the same for every process.
+struct vdso {
+  uint ticks;        // copy of ticks, kept by clockintr()
+  uint ticklen;      // time CSR increments per tick
+  uint64 timefreq;   // time CSR increments per second
+};
+
+// at UPROC: one page per process.
+struct uproc {
+  int pid;
+  int cpu;           // CPU it last returned to user space on
+};
@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "file.h"
 
 /*
  * the kernel's page table.
@@ -129,6 +131,82 @@ walkaddr(pagetable_t pagetable, uint64 va)
   return pa;
 }
 
+// Translation cache for the user-copy routines.
+//
+// Each process remembers the last user page it copied to or
+// from (in any page table) and its physical address, so that a
+// run of small copies pays one page-table walk. Entries are
+// tagged with vmgen, which uvmunmap() and uvmclear() bump
+// whenever a user mapping goes away or loses PTE_U; a stale
+// tag makes the next lookup walk again. New mappings never
+// invalidate a cached one.
+static uint64 vmgen;
+
+// Bump vmgen, invalidating every cached translation.
+static void
+vminval(void)
+{
+  __sync_fetch_and_add(&vmgen, 1);
+}
+
+// Does the caller hold no spin-locks, so that it may sleep?
+static int
+nolocks(void)
+{
+  int r;
+
+  push_off();
+  r = mycpu()->noff == 1;
+  pop_off();
+  return r;
+}
+
+// The PTE of user page va, or 0 if it is not mapped.
+static pte_t*
+upte(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0)
+    return 0;
+  if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+    return 0;
+  return pte;
+}
+
+// Like walkaddr() for page-aligned va0, via the cache, and
+// only for writable pages if write is set: copies must not
+// write read-only pages, which may be shared (PTE_S).
+// Brings in pages of the current process that are not
+// loaded yet (vmfault()).
+static uint64
+uvaddr(pagetable_t pagetable, uint64 va0, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  if(p && p->tc_pt == pagetable && p->tc_va == va0 && (p->tc_w || !write) &&
+     p->tc_gen == __atomic_load_n(&vmgen, __ATOMIC_ACQUIRE))
+    return p->tc_pa;
+  if(p)
+    p->tc_gen = __atomic_load_n(&vmgen, __ATOMIC_ACQUIRE);
+  pte = upte(pagetable, va0);
+  if(pte == 0 && p && pagetable == p->pagetable &&
+     vmfault(p, va0, nolocks()) == 0)
+    pte = upte(pagetable, va0);
+  if(pte && write && (*pte & PTE_W) == 0)
+    pte = 0;
+  if(p && pte){
+    p->tc_pt = pagetable;
+    p->tc_va = va0;
+    p->tc_pa = PTE2PA(*pte);
+    p->tc_w = (*pte & PTE_W) != 0;
+  } else if(p){
+    p->tc_pt = 0;
+  }
+  return pte ? PTE2PA(*pte) : 0;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -198,10 +276,14 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       panic("uvmunmap: not a leaf");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if(*pte & PTE_S)
+        pcache_put(pa);
+      else
+        kfree((void*)pa);
     }
     *pte = 0;
   }
+  vminval();
 }
 
 // create an empty user page table.
@@ -337,6 +419,13 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       continue;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_S){
+      // read-only text: share the page
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      pcache_dup(pa);
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -363,14 +452,15 @@ uvmclear(pagetable_t pagetable, uint64 va)
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
+  vminval();
 }
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 //
-// Usa walkaddr(): asume que las páginas deben estar ya mapeadas;
-// si no lo están, el fallo lo resuelve el manejador de traps (lazy_alloc).
+// Usa uvaddr(): las páginas del proceso que aún no están
+// cargadas (exec perezoso, heap perezoso) se traen con vmfault().
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
@@ -380,7 +470,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     va0 = PGROUNDDOWN(dstva);
     if(va0 >= MAXVA)
       return -1;
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -405,7 +495,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -432,7 +522,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -463,6 +553,60 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
+// User-copy cursor: copies a sequence of small pieces to or
+// from consecutive user addresses, translating each page once.
+// The translation is not revalidated, so a cursor must not be
+// kept across anything that can unmap the user memory.
+void
+ucinit(struct ucursor *c, pagetable_t pagetable, uint64 va)
+{
+  c->pagetable = pagetable;
+  c->va = va;
+  c->pgva = 0;
+  c->pa = 0;
+}
+
+// Copy len bytes between the cursor and kernel buffer kbuf,
+// to user memory if out is set, else from it, and advance.
+// Return 0 on success, -1 on error.
+static int
+ucmove(struct ucursor *c, char *kbuf, uint64 len, int out)
+{
+  uint64 n, va0;
+
+  while(len > 0){
+    va0 = PGROUNDDOWN(c->va);
+    if(c->pa == 0 || c->pgva != va0){
+      if(va0 >= MAXVA || (c->pa = uvaddr(c->pagetable, va0, out)) == 0)
+        return -1;
+      c->pgva = va0;
+    }
+    n = PGSIZE - (c->va - va0);
+    if(n > len)
+      n = len;
+    if(out)
+      memmove((void *)(c->pa + (c->va - va0)), kbuf, n);
+    else
+      memmove(kbuf, (void *)(c->pa + (c->va - va0)), n);
+    len -= n;
+    kbuf += n;
+    c->va += n;
+  }
+  return 0;
+}
+
+int
+ucin(struct ucursor *c, void *dst, uint64 len)
+{
+  return ucmove(c, dst, len, 0);
+}
+
+int
+ucout(struct ucursor *c, void *src, uint64 len)
+{
+  return ucmove(c, src, len, 1);
+}
+
 /************************************************************
  * Lazy allocation helpers
  ************************************************************/
@@ -496,32 +640,117 @@ lazy_wr_alloc(uint64 va, struct proc *p)
   return 0;
 }
 
-// Lazy alloc para sbrk(): se llama desde el manejador de traps
-// cuando hay un page fault de load/store dentro de [stack, sz).
+// The segment of p that va falls in, or 0.
+static struct vmseg*
+findseg(struct proc *p, uint64 va)
+{
+  int i;
+
+  for(i = 0; i < p->nseg; i++)
+    if(va >= p->seg[i].va && va < p->seg[i].va + p->seg[i].memsz)
+      return &p->seg[i];
+  return 0;
+}
+
+// Page fault at va in p, from usertrap() or from a copy to or
+// from user memory. Brings in a page exec() left to be loaded
+// on first use: file content for the part of an ELF segment
+// backed by the file, zeroes for its bss part; outside the
+// segments, a page of the lazily allocated heap. Pages of
+// read-only segments come from the text page cache (pcache.c),
+// shared with other processes running the program. Reading the
+// file sleeps, so a caller that holds spin-locks passes
+// cansleep 0 and only gets zero-filled pages. Nor is the file
+// read while p holds any sleep-lock: a copy done under the lock
+// of inode (or buffer) A would take p->exe's after A, and
+// another process could hold them the other way round. File
+// reads and writes call vmprefault() before locking instead.
+// The file cannot change while p runs it (iexec()), so every
+// page read here is from the image exec() loaded.
+// Returns 0 if the page is now mapped, -1 otherwise.
 int
-lazy_alloc(uint64 stval, struct proc *p)
+vmfault(struct proc *p, uint64 va, int cansleep)
 {
-  uint64 va = PGROUNDDOWN(stval);
+  struct vmseg *s;
+  pte_t *pte;
+  char *mem;
+  uint64 n, pa;
 
-  if(stval >= p->sz || stval < PGROUNDDOWN(p->trapframe->sp)) {
-    // fallo fuera de rango -> matar proceso
-    p->killed = 1;
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz)
     return -1;
-  }
-
-  char *mem = kalloc();
-  if(mem == 0){
-    p->killed = 1;
+  // mapped, but the access is not allowed (guard page, store to text)
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
     return -1;
-  }
 
+  if((s = findseg(p, va)) == 0)
+    return lazy_wr_alloc(va, p);
+
+  n = 0;
+  if(va < s->va + s->filesz){
+    n = s->va + s->filesz - va;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    // lock order: p->exe is only locked holding no sleep-lock
+    if(!cansleep || p->nsleeplk > 0)
+      return -1;
+  }
+  if(n > 0 && (s->perm & PTE_W) == 0){
+    // read-only: map the page shared through the page cache
+    ilock(p->exe);
+    pa = pcache_get(p->exe, s->off + (va - s->va), n);
+    iunlock(p->exe);
+    if(pa){
+      if(mappages(p->pagetable, va, PGSIZE, pa, s->perm|PTE_R|PTE_U|PTE_S) != 0){
+        pcache_put(pa);
+        return -1;
+      }
+      return 0;
+    }
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
   memset(mem, 0, PGSIZE);
-  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem,
-              PTE_W|PTE_R|PTE_U) != 0){
+  if(n > 0){
+    ilock(p->exe);
+    if(readi(p->exe, 0, (uint64)mem, s->off + (va - s->va), n) != n){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, s->perm|PTE_R|PTE_U) != 0){
     kfree(mem);
-    p->killed = 1;
     return -1;
   }
-
   return 0;
 }
+
+// Bring in the pages of [va, va+n) that vmfault() would read
+// from the current process's program file, so that a copy to or
+// from them done later with an inode locked does not need to.
+// Pages it cannot load are left for the copy to fail on.
+void
+vmprefault(uint64 va, uint64 n)
+{
+  struct proc *p = myproc();
+  struct vmseg *s;
+  uint64 a, end;
+  pte_t *pte;
+  int i;
+
+  if(va + n < va)
+    return;
+  for(i = 0; i < p->nseg; i++){
+    s = &p->seg[i];
+    end = s->va + s->filesz;
+    if(va + n < end)
+      end = va + n;
+    for(a = PGROUNDDOWN(va > s->va ? va : s->va); a < end; a += PGSIZE){
+      pte = walk(p->pagetable, a, 0);
+      if((pte == 0 || (*pte & PTE_V) == 0) && vmfault(p, a, 1) < 0)
+        break;
+    }
+  }
+}
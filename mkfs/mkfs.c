@@ -27,11 +27,23 @@ int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
+char *img;    // the image, built in memory and written out at the end
 struct superblock sb;
-char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
+// Programs exec'd on every boot or by almost every command line.
+// They get the first inodes and the data blocks right after the
+// root directory, each as one run. With IPB 4 only init and sh
+// share the root's inode block; the other four fill the next one.
+char *hot[] = { "init", "sh", "ls", "cat", "echo", "grep", 0 };
+
+struct file {
+  char *path;         // as given on the command line
+  char *name;         // in the root directory
+  uint inum;
+};
+
 
 void balloc(int);
 void wsect(uint, void*);
@@ -41,6 +53,7 @@ void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
 void die(const char *);
+void report(struct file*, int);
 
 // convert to riscv byte order
 ushort
@@ -65,14 +78,28 @@ xint(uint x)
   return y;
 }
 
+// Rank of name in hot[], or the number of hot programs if
+// it is not one of them.
+int
+hotrank(char *name)
+{
+  int i;
+
+  for(i = 0; hot[i]; i++)
+    if(strcmp(hot[i], name) == 0)
+      break;
+  return i;
+}
+
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
+  int i, j, n, cc, fd;
+  uint rootino, off;
   struct dirent de;
   char buf[BSIZE];
   struct dinode din;
+  struct file *files, f;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
@@ -107,8 +134,8 @@ main(int argc, char *argv[])
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
-    wsect(i, zeroes);
+  if((img = calloc(FSSIZE, BSIZE)) == 0)
+    die("calloc");
 
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
@@ -127,19 +154,21 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  n = argc - 2;
+  if((files = calloc(n, sizeof(*files))) == 0)
+    die("calloc");
+  for(i = 0; i < n; i++){
+    files[i].path = argv[i + 2];
+
     // get rid of "user/"
     char *shortname;
-    if(strncmp(argv[i], "user/", 5) == 0)
-      shortname = argv[i] + 5;
+    if(strncmp(files[i].path, "user/", 5) == 0)
+      shortname = files[i].path + 5;
     else
-      shortname = argv[i];
+      shortname = files[i].path;
     
     assert(index(shortname, '/') == 0);
 
-    if((fd = open(argv[i], 0)) < 0)
-      die(argv[i]);
-
     // Skip leading _ in name when writing to file system.
     // The binaries are named _rm, _cat, etc. to keep the
     // build operating system from trying to execute them
@@ -148,28 +177,53 @@ main(int argc, char *argv[])
       shortname += 1;
 
     assert(strlen(shortname) <= DIRSIZ);
-    
-    inum = ialloc(T_FILE);
+    files[i].name = shortname;
+  }
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+  // hot programs first, the rest in argument order.
+  for(i = 1; i < n; i++){
+    f = files[i];
+    for(j = i; j > 0 && hotrank(files[j-1].name) > hotrank(f.name); j--)
+      files[j] = files[j-1];
+    files[j] = f;
+  }
 
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
+  // The whole root directory first, so that its blocks come
+  // before the files it lists instead of between them.
+  for(i = 0; i < n; i++){
+    files[i].inum = ialloc(T_FILE);
 
-    close(fd);
+    bzero(&de, sizeof(de));
+    de.inum = xshort(files[i].inum);
+    strncpy(de.name, files[i].name, DIRSIZ);
+    iappend(rootino, &de, sizeof(de));
   }
 
   // fix size of root inode dir
   rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  if((xshort(din.flags) & DI_INLINE) == 0){
+    off = xint(din.size);
+    off = BSIZE * ((off + BSIZE - 1) / BSIZE);
+    din.size = xint(off);
+    winode(rootino, &din);
+  }
+
+  for(i = 0; i < n; i++){
+    if((fd = open(files[i].path, 0)) < 0)
+      die(files[i].path);
+    while((cc = read(fd, buf, sizeof(buf))) > 0)
+      iappend(files[i].inum, buf, cc);
+    close(fd);
+  }
 
   balloc(freeblock);
+  report(files, n);
+
+  for(off = 0; off < FSSIZE * BSIZE; off += cc){
+    if((cc = write(fsfd, img + off, FSSIZE * BSIZE - off)) <= 0)
+      die("write");
+  }
+  close(fsfd);
 
   exit(0);
 }
@@ -177,10 +231,8 @@ main(int argc, char *argv[])
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(write(fsfd, buf, BSIZE) != BSIZE)
-    die("write");
+  assert(sec < FSSIZE);
+  memmove(img + sec * BSIZE, buf, BSIZE);
 }
 
 void
@@ -213,10 +265,8 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
-    die("lseek");
-  if(read(fsfd, buf, BSIZE) != BSIZE)
-    die("read");
+  assert(sec < FSSIZE);
+  memmove(buf, img + sec * BSIZE, BSIZE);
 }
 
 uint
@@ -229,6 +279,7 @@ ialloc(ushort type)
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
+  din.flags = xshort(DI_INLINE);
   winode(inum, &din);
   return inum;
 }
@@ -251,6 +302,51 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block holding file block fbn of din,
+// allocating it if needed by growing the last extent or
+// starting a new one. mkfs allocates sequentially, so a
+// file normally ends up with a single extent.
+uint
+fbmap(struct dinode *din, uint fbn)
+{
+  struct extent ext[NEXTENT + NINDEXTENT];
+  uint lbn, start, len;
+  int i;
+
+  bzero(ext, sizeof(ext));
+  memmove(ext, din->ext, sizeof(din->ext));
+  if(xint(din->extblk) != 0)
+    rsect(xint(din->extblk), (char*)(ext + NEXTENT));
+
+  lbn = 0;
+  for(i = 0; i < NEXTENT + NINDEXTENT; i++){
+    start = xint(ext[i].start);
+    len = xint(ext[i].len);
+    if(len == 0)
+      break;
+    if(fbn < lbn + len)
+      return start + (fbn - lbn);
+    lbn += len;
+  }
+  assert(fbn == lbn);
+
+  if(i > 0 && xint(ext[i-1].start) + xint(ext[i-1].len) == freeblock){
+    i--;
+    ext[i].len = xint(xint(ext[i].len) + 1);
+  } else {
+    assert(i < NEXTENT + NINDEXTENT);
+    if(i == NEXTENT && xint(din->extblk) == 0)
+      din->extblk = xint(freeblock++);
+    ext[i].start = xint(freeblock);
+    ext[i].len = xint(1);
+  }
+
+  memmove(din->ext, ext, sizeof(din->ext));
+  if(i >= NEXTENT)
+    wsect(xint(din->extblk), (char*)(ext + NEXTENT));
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -258,31 +354,31 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
   off = xint(din.size);
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
+  if(xshort(din.flags) & DI_INLINE){
+    if(off + n <= NINLINE){
+      bcopy(p, din.idata + off, n);
+      din.size = xint(off + n);
+      winode(inum, &din);
+      return;
+    }
+    // too big now: move the content out to a block first.
+    bcopy(din.idata, buf, off);
+    bzero(din.idata, NINLINE);
+    din.flags = 0;
+    din.size = 0;
+    winode(inum, &din);
+    iappend(inum, buf, off);
+    rinode(inum, &din);
+  }
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fbmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -295,6 +391,30 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// Print where each file ended up: inline in its inode, or the
+// first block and length of each extent.
+void
+report(struct file *files, int n)
+{
+  struct dinode din;
+  int i, k;
+
+  for(i = 0; i < n; i++){
+    rinode(files[i].inum, &din);
+    printf("layout: %-14s inum %3u size %6u:", files[i].name,
+           files[i].inum, xint(din.size));
+    if(xshort(din.flags) & DI_INLINE){
+      printf(" inline");
+    } else {
+      for(k = 0; k < NEXTENT && din.ext[k].len; k++)
+        printf(" %u+%u", xint(din.ext[k].start), xint(din.ext[k].len));
+      if(din.extblk)
+        printf(" ...");
+    }
+    printf("\n");
+  }
+}
+
 void
 die(const char *s)
 {
@@ -23,9 +23,9 @@ struct msg {
 static void
 work_cpu(uint target_ticks_from_now)
 {
-  uint t0 = uptime(); //uptime devuelve el número de ticks del sistema en ese momento
+  uint t0 = vdso_ticks(); //ticks del sistema en ese momento, leidos de la pagina vdso sin syscall
   volatile uint64 s = 0;
-  while (uptime() - t0 < target_ticks_from_now) { //mientras no hayan pasado el numero de ticks objetivo se quema cpu sin bloquearse, para 
+  while (vdso_ticks() - t0 < target_ticks_from_now) { //mientras no hayan pasado el numero de ticks objetivo se quema cpu sin bloquearse, para 
     //que sea el planificador el que decida cuando entregar la cpu (si hay yield o no)
     for (int i = 0; i < 100000; i++)
       s += i;
@@ -37,9 +37,9 @@ static void
 send_msg(int fd, int type, int role)
 {
   struct msg m;
-  m.pid = getpid();
+  m.pid = vdso_getpid();
   m.type = type;
-  m.t = uptime();
+  m.t = vdso_ticks();
   m.role = role;
   write(fd, &m, sizeof(m));
 }
@@ -160,7 +160,7 @@ for (int i = 0; i < total; i++) {
 }
 
 
-  uint t0 = uptime(); // referencia común de creación
+  uint t0 = vdso_ticks(); // referencia común de creación
 
   int launched = 0; 
   //bucle del padre para crear los hijos, los hijos herendan los valores del padre 
@@ -0,0 +1,19 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+//muestra lo ultimo que ha escrito el kernel con printf
+static char buf[8192];
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if ((n = dmesg(buf, sizeof(buf))) < 0) {
+    fprintf(2, "dmesg: fallo\n");
+    exit(1);
+  }
+  write(1, buf, n);
+  exit(0);
+}
@@ -0,0 +1,30 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+//porcentaje de aciertos, 0 si no hubo accesos
+static int
+pct(uint hits, uint misses)
+{
+  if (hits + misses == 0)
+    return 0;
+  return (int)((uint64)hits * 100 / (hits + misses));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct fsstat st;
+
+  if (fsstat(&st) < 0) {
+    fprintf(2, "fsstat: fallo\n");
+    exit(1);
+  }
+
+  printf("inodos: %d en la tabla, %d referenciados\n", st.ninode, st.iactive);
+  printf("  iget: %d aciertos, %d fallos (%d%%), %d lecturas de disco\n",
+         st.ihits, st.imisses, pct(st.ihits, st.imisses), st.ireads);
+  printf("nombres: %d aciertos, %d fallos (%d%%)\n",
+         st.dhits, st.dmisses, pct(st.dhits, st.dmisses));
+  exit(0);
+}
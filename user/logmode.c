@@ -0,0 +1,26 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if (argc != 2) {
+    fprintf(2, "uso: logmode <modo>\n");
+    fprintf(2, "  modo = suma de: 1=group commit asincrono,\n");
+    fprintf(2, "                  2=ordered (datos fuera del log)\n");
+    fprintf(2, "  0=sincrono con datos en el log, 2=sincrono ordered, ...\n");
+    exit(1);
+  }
+
+  int m = atoi(argv[1]);
+  int old = logmode(m);
+
+  if (old < 0) {
+    fprintf(2, "logmode: modo invalido %d\n", m);
+    exit(1);
+  }
+
+  printf("logmode: %d -> %d\n", old, m);
+  exit(0);
+}
@@ -0,0 +1,85 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Mide el rendimiento de un pipe: un hijo escribe <kb> KB en
+// bloques de <bs> bytes y el padre los lee y cuenta los ticks.
+// Opcionalmente se fija la capacidad del pipe con pipesize().
+
+#define MAXBS 8192
+
+static char buf[MAXBS];
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2], kb, bs, psz, n, pid;
+  uint t0, t1, total, left;
+
+  kb = 4096;
+  bs = 4096;
+  psz = 0;
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    bs = atoi(argv[2]);
+  if(argc > 3)
+    psz = atoi(argv[3]);
+  if(argc > 4 || kb <= 0 || bs <= 0 || bs > MAXBS || psz < 0){
+    fprintf(2, "uso: pipebench [kb] [bs] [pipesz]\n");
+    fprintf(2, "  kb     : KB a transferir (defecto 4096)\n");
+    fprintf(2, "  bs     : bytes por write/read, max %d (defecto 4096)\n", MAXBS);
+    fprintf(2, "  pipesz : capacidad del pipe en bytes (defecto la del kernel)\n");
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe fallo\n");
+    exit(1);
+  }
+  if((psz = pipesize(fds[0], psz)) < 0){
+    fprintf(2, "pipebench: pipesize fallo\n");
+    exit(1);
+  }
+
+  total = (uint)kb * 1024;
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork fallo\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // hijo: escritor
+    close(fds[0]);
+    memset(buf, 'x', bs);
+    for(left = total; left > 0; left -= n){
+      n = left < bs ? left : bs;
+      if(write(fds[1], buf, n) != n){
+        fprintf(2, "pipebench: write fallo\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  // padre: lector
+  close(fds[1]);
+  left = total;
+  while(left > 0 && (n = read(fds[0], buf, bs)) > 0)
+    left -= n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+
+  if(left != 0){
+    fprintf(2, "pipebench: faltan %d bytes\n", left);
+    exit(1);
+  }
+  if(t1 == t0)
+    t1 = t0 + 1;
+  // 1 tick ~ 10 ms
+  printf("pipebench: %d KB en %d ticks, %d KB/s (pipe de %d bytes)\n",
+         kb, t1 - t0, kb * 100 / (t1 - t0), psz);
+  exit(0);
+}
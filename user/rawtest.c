@@ -18,6 +18,7 @@ int
 main(int argc, char *argv[])
 {
   char c;
+  int timeout = argc > 1 && strcmp(argv[1], "-t") == 0;
 
   printf("Prueba de consola raw\n");
   printf("Pulsa teclas y se mostrara su valor hexadecimal.\n");
@@ -28,9 +29,18 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  //con -t, read vuelve con 0 bytes si no llega nada en 10 ticks (~1 s)
+  if(timeout)
+    term_timeout(0, 10);
+
   while(1){
     int result = read(0, &c, 1);
 
+    if(timeout && result == 0){
+      printf("(nada en 10 ticks)\n");
+      continue;
+    }
+
     if(result != 1){
       restore_console();
       fprintf(2, "rawtest: error leyendo la consola\n");
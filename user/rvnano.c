@@ -77,11 +77,69 @@ static void editor_cut_line(void);
 static void editor_paste_line(void);
 static void editor_process_keys_batch(void);
 
+//Todo lo que se dibuja se acumula aqui y sale con un solo write
+//por pasada del bucle principal, en vez de un write por trozo
+static char out_buffer[4096];
+static int out_length;
+
+//Envia a la consola lo acumulado
+static void
+terminal_flush(void)
+{
+  if(out_length > 0)
+    write(1, out_buffer, out_length);
+  out_length = 0;
+}
+
+//Agrega n bytes a la salida pendiente
+static void
+terminal_append(char *text, int n)
+{
+  if(out_length + n > sizeof(out_buffer))
+    terminal_flush();
+
+  if(n > sizeof(out_buffer)){
+    write(1, text, n);
+    return;
+  }
+
+  memmove(out_buffer + out_length, text, n);
+  out_length += n;
+}
+
 //Escribe una cadena completa sin depender de printf
 static void
 terminal_write(char *text)
 {
-  write(1, text, strlen(text));
+  terminal_append(text, strlen(text));
+}
+
+//Mueve el cursor a (fila, columna), contando desde 1
+static void
+terminal_goto(int y, int x)
+{
+  char seq[24];
+  char digits[12];
+  int n = 0;
+  int i;
+
+  seq[n++] = '\x1b';
+  seq[n++] = '[';
+
+  i = 0;
+  do { digits[i++] = '0' + y % 10; y /= 10; } while(y > 0);
+  while(i > 0)
+    seq[n++] = digits[--i];
+
+  seq[n++] = ';';
+
+  i = 0;
+  do { digits[i++] = '0' + x % 10; x /= 10; } while(x > 0);
+  while(i > 0)
+    seq[n++] = digits[--i];
+
+  seq[n++] = 'H';
+  terminal_append(seq, n);
 }
 
 
@@ -96,6 +154,31 @@ editor_cleanup(void)
   terminal_write("\x1b[?25h");  // Mostrar cursor
   terminal_write("\x1b[2J");    // Limpiar pantalla
   terminal_write("\x1b[H");     // Cursor arriba
+  terminal_flush();
+}
+
+//Entrada pendiente: en modo crudo un read devuelve todo lo que ha
+//llegado de golpe (una secuencia de escape entera, un pegado...)
+static char in_buffer[256];
+static int in_length;
+static int in_position;
+
+//Lee un byte de la entrada, con un read solo cuando no queda nada
+static int
+input_read_byte(char *c)
+{
+  if(in_position == in_length){
+    in_length = read(0, in_buffer, sizeof(in_buffer));
+    in_position = 0;
+
+    if(in_length <= 0){
+      in_length = 0;
+      return 0;
+    }
+  }
+
+  *c = in_buffer[in_position++];
+  return 1;
 }
 
 //Lee una tecla o una secuencia especial
@@ -105,7 +188,7 @@ editor_read_key(void)
 {
   char c;
 
-  if(read(0, &c, 1) != 1)
+  if(input_read_byte(&c) != 1)
     return -1;
 
   if(c != '\x1b')
@@ -113,15 +196,15 @@ editor_read_key(void)
 
   char sequence[3];
 
-  if(read(0, &sequence[0], 1) != 1)
+  if(input_read_byte(&sequence[0]) != 1)
     return '\x1b';
 
-  if(read(0, &sequence[1], 1) != 1)
+  if(input_read_byte(&sequence[1]) != 1)
     return '\x1b';
 
   if(sequence[0] == '['){
     if(sequence[1] >= '0' && sequence[1] <= '9'){
-      if(read(0, &sequence[2], 1) != 1)
+      if(input_read_byte(&sequence[2]) != 1)
         return '\x1b';
 
       if(sequence[2] == '~'){
@@ -285,7 +368,7 @@ editor_draw_rows(void)
         if(available > SCREEN_COLS)
           available = SCREEN_COLS;
 
-        write(1, line->text + start, available);
+        terminal_append(line->text + start, available);
       }
     }
 
@@ -327,7 +410,7 @@ editor_refresh_screen(void)
   int screen_x =
     editor.cursor_x - editor.column_offset + 1;
 
-  printf("\x1b[%d;%dH", screen_y, screen_x);
+  terminal_goto(screen_y, screen_x);
 
   //terminal_write("\x1b[?25h");
 }
@@ -390,14 +473,14 @@ editor_mark_rows_dirty_from(int file_y)
 static void
 editor_refresh_title(void)
 {
-  printf("\x1b[1;1H");
+  terminal_goto(1, 1);
   editor_draw_title();
 }
 
 static void
 editor_refresh_status(void)
 {
-  printf("\x1b[%d;1H", TEXT_BOTTOM + 1);
+  terminal_goto(TEXT_BOTTOM + 1, 1);
   editor_draw_status();
 }
 
@@ -412,7 +495,7 @@ editor_refresh_line_from(int file_y, int file_x)
   }
 
   if(file_y >= editor.line_count){
-    printf("\x1b[%d;1H", screen_y);
+    terminal_goto(screen_y, 1);
     terminal_write("~");
     terminal_write("\x1b[K");
     return;
@@ -440,7 +523,7 @@ editor_refresh_line_from(int file_y, int file_x)
   if(screen_x < 1 || screen_x > SCREEN_COLS)
     return;
 
-  printf("\x1b[%d;%dH", screen_y, screen_x);
+  terminal_goto(screen_y, screen_x);
 
   int available = line->length - file_x;
   int max_visible = SCREEN_COLS - screen_x + 1;
@@ -449,7 +532,7 @@ editor_refresh_line_from(int file_y, int file_x)
     if(available > max_visible)
       available = max_visible;
 
-    write(1, line->text + file_x, available);
+    terminal_append(line->text + file_x, available);
   }
 
   //Borra desde la posición actual hasta el final de la línea eso limpia restos cuando se borra texto
@@ -477,7 +560,7 @@ editor_refresh_rows_from(int file_y)
     int screen_y = TEXT_TOP + screen_row;
     int current_file_y = editor.row_offset + screen_row;
 
-    printf("\x1b[%d;1H", screen_y);
+    terminal_goto(screen_y, 1);
     terminal_write("\x1b[2K");
 
     if(current_file_y >= editor.line_count){
@@ -493,7 +576,7 @@ editor_refresh_rows_from(int file_y)
         if(available > SCREEN_COLS)
           available = SCREEN_COLS;
 
-        write(1, line->text + start, available);
+        terminal_append(line->text + start, available);
       }
     }
   }
@@ -1092,7 +1175,7 @@ editor_place_cursor(void)
   int screen_x =
     editor.cursor_x - editor.column_offset + 1;
 
-  printf("\x1b[%d;%dH", screen_y, screen_x);
+  terminal_goto(screen_y, screen_x);
 }
 
 //procesar varios caracteres de golpe (en lote)
@@ -1101,16 +1184,47 @@ editor_process_keys_batch(void)
 {
   editor_process_key();
 
-  while(term_available() > 0){
+  while(in_position < in_length){
     editor_process_key();
   }
 }
 
+//rvnano -t archivo: redibuja la pantalla completa REFRESH_ROUNDS
+//veces y muestra cuantos ticks tardo, para medir la salida a consola
+#define REFRESH_ROUNDS 20
+
+static void
+editor_time_refresh(void)
+{
+  int i;
+  uint t0;
+  uint t1;
+
+  t0 = uptime();
+  for(i = 0; i < REFRESH_ROUNDS; i++){
+    editor_refresh_screen();
+    terminal_flush();
+  }
+  t1 = uptime();
+
+  editor_cleanup();
+  printf("rvnano: %d redibujados en %d ticks\n", REFRESH_ROUNDS, t1 - t0);
+  exit(0);
+}
+
 int
 main(int argc, char *argv[])
 {
+  int timing = 0;
+
+  if(argc == 3 && strcmp(argv[1], "-t") == 0){
+    timing = 1;
+    argv++;
+    argc--;
+  }
+
   if(argc != 2){
-    fprintf(2, "Uso: rvnano archivo\n");
+    fprintf(2, "Uso: rvnano [-t] archivo\n");
     exit(1);
   }
 
@@ -1122,9 +1236,15 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  //un read bloquea hasta que haya al menos una tecla
+  term_timeout(1, 0);
+
   terminal_write("\x1b[2J");
   terminal_write("\x1b[H");
 
+  if(timing)
+    editor_time_refresh();
+
   while(1){
     if(full_refresh_needed){
       editor_refresh_screen();
@@ -1169,6 +1289,7 @@ main(int argc, char *argv[])
       }
     }
 
+    terminal_flush();
     editor_process_keys_batch();
   }
 
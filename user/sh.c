@@ -12,6 +12,7 @@
 #define BACK  5
 
 #define MAXARGS 10
+#define PIPESZ  (16*1024)  // capacity asked for pipeline pipes
 
 struct cmd {
   int type;
@@ -51,8 +52,13 @@ struct backcmd {
 
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
+void syntax(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 void runcmd(struct cmd*) __attribute__((noreturn));
+int runfast(struct cmd*);
+
+int badsyntax;  // set by syntax() while parsing a line
 
 // Execute cmd.  Never returns.
 void
@@ -102,6 +108,8 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
+    // a bigger ring lets both sides run longer between switches.
+    pipesize(p[0], PIPESZ);
     if(fork1() == 0){
       close(1);
       dup(p[1]);
@@ -131,6 +139,90 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can cmd be started with spawn() alone: programs,
+// redirections and pipes?
+int
+spawnable(struct cmd *cmd)
+{
+  struct pipecmd *pcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    return ((struct execcmd*)cmd)->argv[0] != 0;
+  case REDIR:
+    return spawnable(((struct redircmd*)cmd)->cmd);
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    return spawnable(pcmd->left) && spawnable(pcmd->right);
+  }
+  return 0;
+}
+
+// Start cmd with fds 0, 1 and 2 taken from the shell's fds
+// fdmap[0..2]. Returns the number of processes started.
+int
+spawncmd(struct cmd *cmd, int *fdmap)
+{
+  int p[2], map[3], fd, n;
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  memmove(map, fdmap, sizeof(map));
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(spawn(ecmd->argv[0], ecmd->argv, map, 3) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    map[rcmd->fd] = fd;
+    n = spawncmd(rcmd->cmd, map);
+    close(fd);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0)
+      panic("pipe");
+    pipesize(p[0], PIPESZ);
+    map[1] = p[1];
+    n = spawncmd(pcmd->left, map);
+    map[1] = fdmap[1];
+    map[0] = p[0];
+    n += spawncmd(pcmd->right, map);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  panic("spawncmd");
+  return 0;
+}
+
+// Run a simple command or pipeline without forking the shell,
+// and wait for it. Returns -1, having done nothing, for other
+// commands, which runcmd() runs in a child.
+int
+runfast(struct cmd *cmd)
+{
+  int fdmap[3] = { 0, 1, 2 };
+  int n;
+
+  if(!spawnable(cmd))
+    return -1;
+  for(n = spawncmd(cmd, fdmap); n > 0; n--)
+    wait(0);
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -146,6 +238,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -165,9 +258,17 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    // parsed here, so that simple commands and pipelines can
+    // be spawn()ed instead of run by a forked copy of the shell.
+    cmd = parsecmd(buf);
+    if(cmd == 0)
+      continue;
+    if(runfast(cmd) < 0){
+      if(fork1() == 0)
+        runcmd(cmd);
+      wait(0);
+    }
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -179,6 +280,15 @@ panic(char *s)
   exit(1);
 }
 
+// A parse error: the line is reported and not run.
+void
+syntax(char *s)
+{
+  if(!badsyntax)
+    fprintf(2, "%s\n", s);
+  badsyntax = 1;
+}
+
 int
 fork1(void)
 {
@@ -332,11 +442,16 @@ parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
+  badsyntax = 0;
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !badsyntax){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(badsyntax){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -380,8 +495,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -406,8 +523,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -432,13 +551,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -492,3 +615,28 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free the nodes parsecmd() allocated.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,64 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Mide lo que cuesta ir y volver del kernel: n llamadas seguidas a
+// getpid y uptime (camino rapido del trampolin) y a sbrk(0) (camino
+// normal, sin trabajo), y lo que cuesta leer los ticks de la pagina
+// vdso sin entrar, con el reloj time de RISC-V (10 MHz en qemu,
+// 100 ns por unidad).
+
+static inline uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+static void
+report(char *name, int n, uint64 t)
+{
+  // en centesimas de unidad para no perder resolucion
+  uint64 per = t * 100 / n;
+  printf("%s: %d.%d%d unidades de time (%d ns) por llamada\n", name,
+         (int)(per / 100), (int)(per / 10 % 10), (int)(per % 10),
+         (int)(per));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i;
+  uint64 t0;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2 || n <= 0){
+    fprintf(2, "uso: sysbench [n]\n");
+    exit(1);
+  }
+
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    getpid();
+  report("getpid", n, rdtime() - t0);
+
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    uptime();
+  report("uptime", n, rdtime() - t0);
+
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    vdso_ticks();
+  report("vdso_ticks", n, rdtime() - t0);
+
+  t0 = rdtime();
+  for(i = 0; i < n; i++)
+    sbrk(0);
+  report("sbrk(0)", n, rdtime() - t0);
+
+  exit(0);
+}
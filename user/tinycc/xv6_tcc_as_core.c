@@ -11,8 +11,8 @@ para generar el ELF relocatable, para ello realizaré los siguientes pasos:
 2. Se dividirá el líneas
 3. Con el parser de líneas de analizará cada una de ellas y se meterán en la sección .text del código del ELF
 4. Se generarán las tablas .symtab (tabla de símbolos), .strtab (tabla de nombres/cadenas) y .rela.text()
-6. Se construirá la imagen ELF completa relocatable (foramto ELF64 ET_REL)
-7. Se escribirá dicha imagen en el fichero .o
+6. Se calculará la disposición del ELF relocatable (foramto ELF64 ET_REL)
+7. Se escribirá en el fichero .o con un solo writev(), sin montar antes la imagen en memoria
 */
 #include "kernel/types.h"
 #include "kernel/fcntl.h"
@@ -29,7 +29,8 @@ entonces 4096 / 24 = 170 entradas/símbolos. OJO todavía tengo el límite en Xv
 #define XV6_TCC_AS_RELA_CAPACITY 4096 /*capacidad tabla de relocaciones. Cada entrada de la tabla de relocaciones es del tipo Xv6TccElfRela ---> 24 bytes por entrada
 entonces 4096 / 24 = 170 relocaciones. Pero el constructor interno limita las relocaciones a 64, debo cambiar eso!*/
 #define XV6_TCC_AS_SHSTRTAB_CAPACITY 256 //la tabla ".shstrtab" guarda los nombres de las secciones del elf  (.text, .re.text, .symtab, .strtab, .shstrtab)
-#define XV6_TCC_AS_IMAGE_CAPACITY 32768 //Máximo tamaño del fichero objeto (cabecera ELF + secciones ELF + tabla de cabeceras de sección)
+#define XV6_TCC_AS_IMAGE_CAPACITY 32768 /*Máximo tamaño del fichero objeto (cabecera ELF + secciones ELF + tabla de cabeceras de sección).
+Ya no se reserva un buffer de este tamaño porque el .o se escribe con writev() desde los búferes de arriba, cuya suma nunca lo supera*/
 
 //arrays de almacenamiento 
 //tipo "char" los búferes que usan texto. Tipo "uchar" los que puedden contener cualquier valor y no debe interpretarse como cadena
@@ -41,7 +42,6 @@ static uchar symtab_data[XV6_TCC_AS_SYMTAB_CAPACITY]; //array de la tabla de sí
 static char strtab_data[XV6_TCC_AS_STRTAB_CAPACITY]; //array de la tabla de la tabla de cadenas .strtab (cada entrada guarda solamente el nombre del símbolo)
 static uchar rela_text_data[XV6_TCC_AS_RELA_CAPACITY]; //array de la tabla de relocaciones .re.text
 static char shstrtab_data[XV6_TCC_AS_SHSTRTAB_CAPACITY]; //array de la tabla del nombre de las secciones elf (.text, .re.text, .symtab, .strtab, .shstrtab)
-static uchar image_data[XV6_TCC_AS_IMAGE_CAPACITY]; //Aquí se almacenará todo los bytes del fichero ELF64 ET_REL
 
 static struct Xv6TccObjectBuilder object;
 
@@ -230,7 +230,7 @@ xv6_tcc_as_core(char *input, char *output)
   struct Xv6TccElfStringTable strtab; //tabla de cadenas
   struct Xv6TccElfBuffer rela_text; //tabla de relocaciones de .text
   struct Xv6TccElfStringTable shstrtab; //tabla de nombres de las secciones 
-  struct Xv6TccElfBuffer image; //aquí irá la imagen completa del fichero objeto. Ósea el ELF relocatable, este array se escribirá en el fichero de salida .o
+  uint image_size; //tamaño del fichero objeto .o escrito
 
   //valido que los nombres de los ficheros no sean nulos
   if(!input || !output)
@@ -267,9 +267,6 @@ xv6_tcc_as_core(char *input, char *output)
   shstrtab.size = 0;
   shstrtab.capacity = sizeof(shstrtab_data);
 
-  image.data = image_data;
-  image.size = 0;
-  image.capacity = sizeof(image_data);
 
   //icializar todos los buferes para crear los elementos del ELF en memoria: Inicializo el constructor del objeto para que object apunte a todos los búferes
   if(xv6_tcc_object_init(&object, &text, &symtab,
@@ -301,11 +298,11 @@ xv6_tcc_as_core(char *input, char *output)
     return -1;
   }
 
-  /*Construye el ELF completo (con sus cabeceras y resto de info) y eso lo guarda en "image_data"
-  Luego escribe "image_data" en el fichero de salida .o ELF relocatable. 
-  Ósea primero crear la imagen ELF en memoria y luego la escribe en disco*/
+  /*Calcula el ELF completo (con sus cabeceras y resto de info) y lo escribe en el fichero de
+  salida .o ELF relocatable con un solo writev(), directamente desde los búferes de cada sección,
+  sin copiarlo antes a una imagen en memoria*/
   if(xv6_tcc_write_rel_object(&object, output,
-                              &image, &shstrtab) < 0){
+                              &shstrtab, &image_size) < 0){
     fprintf(2, "asxv6: no se pudo escribir %s\n", output);
     return -1;
   }
@@ -319,6 +316,6 @@ xv6_tcc_as_core(char *input, char *output)
           symtab.size / (int)sizeof(struct Xv6TccElfSym));
   fprintf(1, "  .rela.text: %d entradas\n",
           rela_text.size / (int)sizeof(struct Xv6TccElfRela));
-  fprintf(1, "  ELF completo: %d bytes\n", image.size);
+  fprintf(1, "  ELF completo: %d bytes\n", image_size);
   return 0;
 }
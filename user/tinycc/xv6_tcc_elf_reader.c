@@ -12,6 +12,8 @@ Donante conceptual:
 
 #include "kernel/types.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "kernel/uring.h"
 #include "user/user.h"
 #include "user/tinycc/xv6_tcc_elf_reader.h"
 
@@ -686,12 +688,94 @@ La función:
 4. Cierra el descriptor
 5. Analiza y valida los bytes cargados
 */
+/*
+Carga el fichero completo con el anillo de llamadas en lote (kernel/uring.h):
+open, las dos lecturas y close van en un solo ring_enter(), en vez de
+cuatro llamadas al sistema
+
+Como en el camino de readv(), la segunda lectura pide un byte "extra" para
+detectar ficheros que no caben en el buffer. Sirve para ficheros normales,
+donde la primera lectura trae todo lo que hay hasta capacity
+
+Devuelve 0 si se cargo, -1 si fallo y 1 si hay que usar el camino normal:
+no hay anillo, no queda sitio para las cuatro entradas o el kernel no las
+ejecuto todas
+*/
+static int
+xv6_tcc_load_with_ring(const char *path, struct Xv6TccElfBuffer *storage)
+{
+  struct ring *ring;
+  struct ring_cqe *completion;
+  int result[4], posted[4], i;
+  uchar extra;
+
+  ring = ring_setup();
+  if(ring == (struct ring*)-1)
+    return 1;
+
+  /*
+  Las cuatro entradas van juntas o ninguna: si quedara alguna en la cola,
+  el siguiente ring_enter() la ejecutaria (un open sin su close deja un
+  descriptor abierto). Tampoco puede haber entradas de otro lote, y las
+  cuatro completions tienen que caber
+  */
+  if(ring->sq_tail != ring->sq_head ||
+     ring->cq_tail - ring->cq_head > RING_ENTRIES - 4)
+    return 1;
+
+  //data de cada entrada: su posicion en el lote
+  ring_push(ring, RING_OPEN, 0, 0, (void*)path, O_RDONLY, 0);
+  ring_push(ring, RING_READ, RING_LASTFD, 0, storage->data,
+            storage->capacity, 1);
+  ring_push(ring, RING_READ, RING_LASTFD, 0, &extra, 1, 2);
+  ring_push(ring, RING_CLOSE, RING_LASTFD, 0, 0, 0, 3);
+
+  ring_enter();
+
+  //lo que el kernel no llego a ejecutar se descarta
+  ring->sq_tail = ring->sq_head;
+
+  for(i = 0; i < 4; i++){
+    result[i] = -1;
+    posted[i] = 0;
+  }
+  //se consumen todas las completions, tambien las que sobren
+  for(; ring->cq_head != ring->cq_tail; ring->cq_head++){
+    completion = &ring->cq[ring->cq_head % RING_ENTRIES];
+    if(completion->data < 4){
+      result[completion->data] = completion->res;
+      posted[completion->data] = 1;
+    }
+  }
+
+  /*
+  Si no se ejecutaron las cuatro se cierra el descriptor que se abrio, si
+  se llego a abrir, y se sigue por el camino normal
+  */
+  if(!posted[0] || !posted[1] || !posted[2] || !posted[3]){
+    if(posted[0] && result[0] >= 0 && !posted[3])
+      close(result[0]);
+    return 1;
+  }
+
+  /*
+  Falla si no se pudo abrir, leer o cerrar, o si la lectura del byte
+  extra trajo algo: el fichero es mas grande que el buffer
+  */
+  if(result[0] < 0 || result[1] < 0 || result[2] != 0 || result[3] < 0)
+    return -1;
+
+  storage->size = result[1];
+  return 0;
+}
+
 int
 xv6_tcc_load_rel_object(const char *path,
                          struct Xv6TccElfBuffer *storage,
                          struct Xv6TccRelObjectView *view)
 {
   int file;
+  int loaded;
 
   /*
   Se validan los argumentos
@@ -706,6 +790,17 @@ xv6_tcc_load_rel_object(const char *path,
      storage->capacity == 0)
     return -1;
 
+  /*
+  Primero se intenta con el anillo de llamadas en lote. Si no está
+  disponible se sigue por el camino de siempre
+  */
+  loaded = xv6_tcc_load_with_ring(path, storage);
+  if(loaded < 0)
+    return -1;
+  if(loaded == 0)
+    return xv6_tcc_parse_rel_object(
+        storage->data, storage->size, view);
+
   //Se abre el fichero objeto en modo de solo lectura
   file = open(path, O_RDONLY);
   if(file < 0)
@@ -720,31 +815,26 @@ xv6_tcc_load_rel_object(const char *path,
   storage->size = 0;
 
   /*
-  Se continúa leyendo mientras quede espacio libre en el buffer
+  Se lee con readv() usando dos trozos:
+
+      iov[0] ---> el espacio libre del buffer: data + size, capacity - size
+      iov[1] ---> un byte adicional "extra"
 
-  storage->size indica el primer offset libre
+  Así una sola llamada llena el buffer y a la vez detecta si el fichero
+  tiene más bytes de los que caben, sin una lectura aparte de un byte.
 
-  storage->capacity - storage->size indica cuántos bytes quedan disponibles
+  Se repite porque read/readv puede devolver menos bytes de los pedidos
   */
-  while(storage->size < storage->capacity){
+  while(1){
+    struct iovec iov[2];
+    uchar extra;
     int amount;
 
-    /*
-    Los nuevos bytes se escriben después de los que ya fueron leídos:
-
-        storage->data + storage->size
-
-    Ejemplo:
-
-        size = 100
-        capacity = 1000
-
-        la lectura comienza en data + 100
-        como máximo se pueden leer 900 bytes
-    */
-    amount = read(file,
-             storage->data + storage->size,
-             storage->capacity - storage->size);
+    iov[0].iov_base = storage->data + storage->size;
+    iov[0].iov_len = storage->capacity - storage->size;
+    iov[1].iov_base = &extra;
+    iov[1].iov_len = 1;
+    amount = readv(file, iov, 2);
 
     /*
     Un resultado negativo indica un error de lectura
@@ -756,48 +846,24 @@ xv6_tcc_load_rel_object(const char *path,
     }
 
     /*
-    read() devuelve cero cuando se ha alcanzado el final del fichero
+    readv() devuelve cero cuando se ha alcanzado el final del fichero
 
     En ese momento ya se han cargado todos sus bytes y se sale del bucle
     */
     if(amount == 0)
       break;
 
-    //Se actualiza el número de bytes válidos dentro del buffer
-    storage->size += amount;
-  }
-
-  /*
-  Si size es igual a capacity, el buffer quedó completamente lleno
-
-  En ese caso todavía no sabemos si:
-  - el fichero mide exactamente capacity bytes;
-  - o existen más bytes que ya no caben en el buffer.
-
-  Para distinguir ambos casos se intenta leer un byte adicional
-  */
-  if(storage->size == storage->capacity){
-    uchar extra;
-    int amount;
-
-    amount = read(file, &extra, 1);
-
     /*
-    Si read() devuelve cero, el fichero terminaba exactamente al llenar
-    el buffer y es válido
-
-    Si devuelve uno, existe al menos otro byte y el fichero es demasiado
-    grande.
-
-    Si devuelve un valor negativo, ocurrió un error de lectura
-
-    En los dos últimos casos amount será distinto de cero y se devuelve
-    error
+    Si se llegó a escribir en "extra", el fichero no cabe en el buffer
+    y es demasiado grande
     */
-    if(amount != 0){
+    if(amount > storage->capacity - storage->size){
       close(file);
       return -1;
     }
+
+    //Se actualiza el número de bytes válidos dentro del buffer
+    storage->size += amount;
   }
 
   /*
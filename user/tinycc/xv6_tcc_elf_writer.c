@@ -14,6 +14,7 @@ Donante conceptual:
 
 #include "kernel/types.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
 #include "user/user.h"
 #include "user/tinycc/xv6_tcc_elf_writer.h"
 
@@ -48,6 +49,26 @@ copy_buffer(struct Xv6TccElfBuffer *image,
   return 0;
 }
 
+/*Devuelve los bytes de la sección con índice "index" (de .text a .shstrtab)*/
+static const void *
+section_data(const struct Xv6TccObjectBuilder *object,
+             const struct Xv6TccElfStringTable *shstrtab, int index)
+{
+  switch(index){
+  case XV6_TCC_REL_SECTION_TEXT:
+    return object->text->data;
+  case XV6_TCC_REL_SECTION_RELA_TEXT:
+    return object->rela_text->data;
+  case XV6_TCC_REL_SECTION_SYMTAB:
+    return object->symtab->data;
+  case XV6_TCC_REL_SECTION_STRTAB:
+    return object->strtab->data;
+  case XV6_TCC_REL_SECTION_SHSTRTAB:
+    return shstrtab->data;
+  }
+  return 0;
+}
+
 /*Rellena los primeros bytes de la cabecera ELF. 
 Primero mete la firma ELF:
 header->e_ident[0] = 0x7f;
@@ -71,21 +92,25 @@ fill_elf_ident(struct Xv6TccElfHeader *header)
   header->e_ident[6] = XV6_TCC_EV_CURRENT;
 }
 
-/*Contruye la imagen completa del ELF (la secuencia de bytes) en memoria en el buffer "Image" pero todavía no la
-escribe en disco. Diferencia entre el buffer object e Image: Object contiene toda la información del objeto pero dividia lógicamente: 
-punteros a los búferes, estado de finalización, relocaciones internas, símbolos internos. En cambio en imagen tengo la secuencia de bytes 
-en crudo a escribir en el fichero objeto .o directo*/
-int
-xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
-                       struct Xv6TccElfBuffer *image,
-                       struct Xv6TccElfStringTable *shstrtab)
+/*Redondea hacía arriba hasta el siguiente múltiplo de align (potencia de 2)*/
+static uint
+elf_align(uint value, uint align)
+{
+  return (value + align - 1) & ~(align - 1);
+}
+
+/*Calcula la disposición del ELF relocatable sin copiar ningún byte de las secciones:
+rellena .shstrtab con los nombres, calcula el offset de cada sección siguiendo el mismo
+orden y alineación que la imagen en memoria (cabecera, .text, .rela.text, .symtab, .strtab,
+.shstrtab y al final la tabla de cabeceras de sección) y rellena "header" y "sections".
+Devuelve el tamaño total del fichero o -1 si hay error.*/
+static int
+layout_rel_elf(const struct Xv6TccObjectBuilder *object,
+               struct Xv6TccElfStringTable *shstrtab,
+               struct Xv6TccElfHeader *header,
+               struct Xv6TccElfSectionHeader *sections)
 {
-  struct Xv6TccElfHeader *header; //puntero auxiliar para meter los datos en el header elf
-  struct Xv6TccElfSectionHeader *sections; /*puntero auxiliar para meter los datos en la tabla de header de secciones. 
-  IMPORTANTE: cada entrada de la tabla de cabeceras de sección será un Xv6TccElfSectionHeader y como tengo 6 secciones, 
-  tendrè 6 cabeceras*/
   uint section_names[XV6_TCC_REL_SECTION_COUNT]; //aquí guardaré los offsets de cada nombre de cada seccción en la tabla de nombres de secciones .shstrtab
-  uint header_offset; //var donde se guardará el offset del header ELF (vadrá cero 0)
   uint text_offset;
   uint rela_text_offset;
   uint symtab_offset;
@@ -95,8 +120,7 @@ xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
 
   if(!object || !object->finalized ||
      !object->text || !object->symtab || !object->strtab ||
-     !object->rela_text || !image || !image->data ||
-     !shstrtab || !shstrtab->data)
+     !object->rela_text || !shstrtab || !shstrtab->data)
     return -1;
 
   /*Hay que comprobar los tamaños porque ELF exige tamaños exactos */
@@ -106,14 +130,9 @@ xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
      sizeof(struct Xv6TccElfRela) != 24)
     return -1;
 
-  /*Vaciar la imagen y .shstrtab ---> esto no borra la memoria, solo indicamos que está vacío el buffer (ósea que si 
-  había información antes, pues no es válida)*/
-  image->size = 0;
-  shstrtab->size = 0;
-
   /*Se construye la tabla de secciones:
   \0.text\0.rela.text\0.symtab\0.strtab\0.shstrtab\0
-  
+
   Y se guardan los offsets de cada nombre en section_names: 
   section_names[0] = 0
   section_names[1] = 1
@@ -121,6 +140,7 @@ xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
   section_names[3] = 18
   section_names[4] = 26
   section_names[5] = 34*/
+  shstrtab->size = 0;
   if(put_section_name(shstrtab, "", &section_names[0]) < 0 ||
      section_names[0] != 0 ||
      put_section_name(shstrtab, ".text", &section_names[1]) < 0 ||
@@ -130,53 +150,16 @@ xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
      put_section_name(shstrtab, ".shstrtab", &section_names[5]) < 0)
     return -1;
 
-  /*Se reserva espacio para la cabecera ELF dentro del buffer de la iamgen
-  en "header_offseet = 0", ya que me devuelve el valor donde inica lo reservado.*/
-  if(xv6_tcc_section_add(image, sizeof(struct Xv6TccElfHeader),
-                         sizeof(uint64), &header_offset) < 0 ||
-     header_offset != 0)
-    return -1;
-
-  /*Se copian el contenido de todas las secciones del buffer del fichero objeto (con sus datos) en la imagen del ELF en el siguiente orden:
-    .text
-    .rela.text
-    .symtab
-    .strtab
-    .shstrtab*/
-  if(copy_buffer(image, object->text->data, object->text->size,
-                 4, &text_offset) < 0 ||
-     copy_buffer(image, object->rela_text->data, object->rela_text->size,
-                 sizeof(uint64), &rela_text_offset) < 0 ||
-     copy_buffer(image, object->symtab->data, object->symtab->size,
-                 sizeof(uint64), &symtab_offset) < 0 ||
-     copy_buffer(image, object->strtab->data, object->strtab->size,
-                 1, &strtab_offset) < 0 ||
-     copy_buffer(image, shstrtab->data, shstrtab->size,
-                 1, &shstrtab_offset) < 0)
-    return -1;
-
-  /*En el paso anterior copiamos el contenido de todas las secciones en la "imagen", ahora reservamos espacio 
-  para meter la tabla de las cabeceras de seccción para saber dónde inicia cada sección. Esta cabecerá se pone después
-  de la tabla .shstrtab, aunque en realidad se puede poner en cualquier parte del ELF, ya que el offset de su ubicación 
-  lo indicamos con "header->e_shoff".
-  "section_header_offset = (bytes cabecera elf + bytes de todas las secciones)".
-  IMPORTANTE: cada entrada de la tabla de cabeceras de sección será un Xv6TccElfSectionHeader y como tengo 6 secciones, 
-  tendrè 6 cabeceras*/
-  if(xv6_tcc_section_add(
-         image,
-         XV6_TCC_REL_SECTION_COUNT *
-             sizeof(struct Xv6TccElfSectionHeader),
-         sizeof(uint64), &section_headers_offset) < 0)
-    return -1;
-
- /*Se procederá a meter los datos de la Cabecera ELF*/
-
-
-  //puntero al header ELF, y lo convierto en formato de estructura Xv6TccElfHeader para acceder a sus campos y llenar la cabecera
-  header = (struct Xv6TccElfHeader *)(image->data + header_offset);
-  //puntero a la cabecera de la tabla de secciones y lo convierto en formato de estructura Xv6TccElfSectionHeader y llenar el array de cada entrada
-  sections = (struct Xv6TccElfSectionHeader *)(
-      image->data + section_headers_offset);
+  /*Offsets de cada sección: detrás de la anterior, redondeados a su alineación*/
+  text_offset = elf_align(sizeof(struct Xv6TccElfHeader), 4);
+  rela_text_offset = elf_align(text_offset + object->text->size,
+                               sizeof(uint64));
+  symtab_offset = elf_align(rela_text_offset + object->rela_text->size,
+                            sizeof(uint64));
+  strtab_offset = symtab_offset + object->symtab->size;
+  shstrtab_offset = strtab_offset + object->strtab->size;
+  section_headers_offset = elf_align(shstrtab_offset + shstrtab->size,
+                                     sizeof(uint64));
 
   //limpio todos los bytes de la cabecera ELF poniendo 0's
   memset(header, 0, sizeof(*header));
@@ -249,6 +232,64 @@ xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
   sections[XV6_TCC_REL_SECTION_SHSTRTAB].sh_size = shstrtab->size;
   sections[XV6_TCC_REL_SECTION_SHSTRTAB].sh_addralign = 1;
 
+  return section_headers_offset +
+         XV6_TCC_REL_SECTION_COUNT * sizeof(struct Xv6TccElfSectionHeader);
+}
+
+/*Contruye la imagen completa del ELF (la secuencia de bytes) en memoria en el buffer "Image" pero todavía no la
+escribe en disco. Diferencia entre el buffer object e Image: Object contiene toda la información del objeto pero dividia lógicamente: 
+punteros a los búferes, estado de finalización, relocaciones internas, símbolos internos. En cambio en imagen tengo la secuencia de bytes 
+en crudo a escribir en el fichero objeto .o directo*/
+int
+xv6_tcc_build_rel_elf(const struct Xv6TccObjectBuilder *object,
+                       struct Xv6TccElfBuffer *image,
+                       struct Xv6TccElfStringTable *shstrtab)
+{
+  struct Xv6TccElfHeader header; //cabecera ELF calculada por layout_rel_elf
+  struct Xv6TccElfSectionHeader sections[XV6_TCC_REL_SECTION_COUNT]; //tabla de cabeceras de sección
+  uint header_offset; //var donde se guardará el offset del header ELF (vadrá cero 0)
+  uint offset; //offset que devuelve cada reserva, debe coincidir con el calculado
+  int i;
+
+  if(!image || !image->data)
+    return -1;
+
+  /*Vaciar la imagen ---> esto no borra la memoria, solo indicamos que está vacío el buffer (ósea que si 
+  había información antes, pues no es válida)*/
+  image->size = 0;
+
+  if(layout_rel_elf(object, shstrtab, &header, sections) < 0)
+    return -1;
+
+  /*Se reserva espacio para la cabecera ELF dentro del buffer de la iamgen
+  en "header_offseet = 0", ya que me devuelve el valor donde inica lo reservado.*/
+  if(xv6_tcc_section_add(image, sizeof(struct Xv6TccElfHeader),
+                         sizeof(uint64), &header_offset) < 0 ||
+     header_offset != 0)
+    return -1;
+
+  /*Se copian el contenido de todas las secciones del buffer del fichero objeto (con sus datos) en la imagen del ELF en el siguiente orden:
+    .text
+    .rela.text
+    .symtab
+    .strtab
+    .shstrtab
+  Cada una debe quedar en el offset que puso layout_rel_elf en su cabecera*/
+  for(i = XV6_TCC_REL_SECTION_TEXT; i < XV6_TCC_REL_SECTION_COUNT; i++){
+    if(copy_buffer(image, section_data(object, shstrtab, i),
+                   sections[i].sh_size, sections[i].sh_addralign,
+                   &offset) < 0 ||
+       offset != sections[i].sh_offset)
+      return -1;
+  }
+
+  /*Al final va la tabla de las cabeceras de sección (header.e_shoff)*/
+  if(copy_buffer(image, sections, sizeof(sections), sizeof(uint64),
+                 &offset) < 0 ||
+     offset != header.e_shoff)
+    return -1;
+
+  memmove(image->data + header_offset, &header, sizeof(header));
   return 0;
 }
 
@@ -293,16 +334,65 @@ xv6_tcc_write_elf_file(const char *path,
   return 0;
 }
 
-/*Esta función es por comodidad, hace ambas cosas:
-1. Escribe la imagen ELF en memoria 
-2. Luego escribe esa imagen en disco*/
+/*Escribe el fichero objeto .o directamente desde los búferes del objeto, sin construir
+antes la imagen ELF en memoria: calcula la disposición con layout_rel_elf y manda con un solo
+writev() la cabecera, cada sección (con su relleno de alineación) y la tabla de cabeceras de
+sección. En "size" devuelve el tamaño del fichero escrito.*/
 int
 xv6_tcc_write_rel_object(const struct Xv6TccObjectBuilder *object,
                           const char *path,
-                          struct Xv6TccElfBuffer *image,
-                          struct Xv6TccElfStringTable *shstrtab)
+                          struct Xv6TccElfStringTable *shstrtab,
+                          uint *size)
 {
-  if(xv6_tcc_build_rel_elf(object, image, shstrtab) < 0)
+  static const uchar zeros[sizeof(uint64)]; //relleno para las alineaciones (como mucho 7 bytes)
+  struct Xv6TccElfHeader header;
+  struct Xv6TccElfSectionHeader sections[XV6_TCC_REL_SECTION_COUNT];
+  struct iovec iov[2 * XV6_TCC_REL_SECTION_COUNT + 1];
+  uint position; //offset del fichero al que llegan los trozos puestos en iov
+  int total, count, file, i;
+
+  if(!path || !size)
+    return -1;
+
+  total = layout_rel_elf(object, shstrtab, &header, sections);
+  if(total < 0)
+    return -1;
+
+  /*Lista de trozos: cabecera, (relleno, sección) x 5, relleno, tabla de cabeceras*/
+  count = 0;
+  iov[count].iov_base = &header;
+  iov[count++].iov_len = sizeof(header);
+  position = sizeof(header);
+  for(i = XV6_TCC_REL_SECTION_TEXT; i <= XV6_TCC_REL_SECTION_COUNT; i++){
+    uint offset = (i < XV6_TCC_REL_SECTION_COUNT) ? sections[i].sh_offset
+                                                   : header.e_shoff;
+    if(offset > position){
+      iov[count].iov_base = (void *)zeros;
+      iov[count++].iov_len = offset - position;
+    }
+    if(i < XV6_TCC_REL_SECTION_COUNT){
+      iov[count].iov_base = (void *)section_data(object, shstrtab, i);
+      iov[count++].iov_len = sections[i].sh_size;
+      position = offset + sections[i].sh_size;
+    } else {
+      iov[count].iov_base = sections;
+      iov[count++].iov_len = sizeof(sections);
+    }
+  }
+
+  //se elimina un fichero que tenga el mismo nombre y se crea el nuevo
+  unlink(path);
+  file = open(path, O_CREATE | O_WRONLY);
+  if(file < 0)
+    return -1;
+
+  if(writev(file, iov, count) != total){
+    close(file);
+    return -1;
+  }
+  if(close(file) < 0)
     return -1;
-  return xv6_tcc_write_elf_file(path, image);
+
+  *size = total;
+  return 0;
 }
@@ -4,7 +4,8 @@ xv6_tcc_elf_writer.h
 Construccion y escritura de un fichero objeto ELF64 RISC-V ET_REL.
 Recibe los buffers ya finalizados por Xv6TccObjectBuilder y los empaqueta con
 una cabecera ELF, cabeceras de seccion y una tabla .shstrtab.
-COnstruye el ELF raw en memoria con un buffer llamado "image" y luego hace la escritura en disco
+COnstruye el ELF raw en memoria con un buffer llamado "image" y luego hace la escritura en disco,
+o bien (xv6_tcc_write_rel_object) lo escribe directamente desde los búferes con writev()
 */
 #ifndef XV6_TCC_ELF_WRITER_H
 #define XV6_TCC_ELF_WRITER_H
@@ -90,7 +91,7 @@ int xv6_tcc_write_elf_file(const char *path,
 int xv6_tcc_write_rel_object(
     const struct Xv6TccObjectBuilder *object,
     const char *path,
-    struct Xv6TccElfBuffer *image,
-    struct Xv6TccElfStringTable *shstrtab);
+    struct Xv6TccElfStringTable *shstrtab,
+    uint *size);
 
 #endif
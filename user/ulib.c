@@ -2,6 +2,10 @@
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
 #include "user/user.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
+#include "kernel/uring.h"
 
 //
 // wrapper so that it's OK if main() does not call exit().
@@ -183,3 +187,54 @@ int is_number(char *s) {
   return 1;
 }
 
+//lecturas directas de las paginas que el kernel mapea en cada proceso
+//(kernel/vdso.h): dan lo mismo que uptime() y getpid() sin entrar al kernel
+
+//ticks desde el arranque, como uptime()
+uint
+vdso_ticks(void)
+{
+  return ((volatile struct vdso*)VDSO)->ticks;
+}
+
+//pid del proceso, como getpid()
+int
+vdso_getpid(void)
+{
+  return ((struct uproc*)UPROC)->pid;
+}
+
+//CPU en la que el proceso volvio a modo usuario por ultima vez
+int
+vdso_cpu(void)
+{
+  return ((volatile struct uproc*)UPROC)->cpu;
+}
+
+//incrementos por segundo del registro time (el que lee rdtime)
+uint64
+vdso_timefreq(void)
+{
+  return ((struct vdso*)VDSO)->timefreq;
+}
+
+//encola una operacion en el anillo de llamadas en lote (kernel/uring.h),
+//que se ejecutara en el siguiente ring_enter(); -1 si el anillo esta lleno
+int
+ring_push(struct ring *r, int op, int flags, int fd, void *addr, int len, uint64 data)
+{
+  struct ring_sqe *e;
+
+  if(r->sq_tail - r->sq_head >= RING_ENTRIES)
+    return -1;
+
+  e = &r->sq[r->sq_tail % RING_ENTRIES];
+  e->op = op;
+  e->flags = flags;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->data = data;
+  r->sq_tail++;
+  return 0;
+}
@@ -1,4 +1,8 @@
 struct stat;
+struct fsstat;
+struct pollfd;
+struct ring;
+struct iovec;
 
 // system calls stubs
 int fork(void);
@@ -32,6 +36,21 @@ int setscheduler(int);
 int term_raw(void);
 int term_cooked(void);
 int term_available(void);
+int term_timeout(int, int);
+int fsync(int);
+int logmode(int);
+int pipesize(int, int);
+int splice(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int fsstat(struct fsstat*);
+int spawn(const char*, char**, const int*, int);
+int dmesg(char*, int);
+int poll(struct pollfd*, int, int);
+struct ring* ring_setup(void);
+int ring_enter(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -49,6 +68,11 @@ int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 //nuevas funciones de ulib.c
 int is_number(char *);
+uint vdso_ticks(void);
+int vdso_getpid(void);
+int vdso_cpu(void);
+uint64 vdso_timefreq(void);
+int ring_push(struct ring*, int, int, int, void*, int, uint64);
 
 // umalloc.c
 void* malloc(uint);
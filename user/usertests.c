@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
+#include "kernel/poll.h"
+#include "kernel/uring.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -788,6 +791,107 @@ pipe1(char *s)
   }
 }
 
+// writev() three pieces, read them back with readv() into
+// differently sized pieces, and patch the middle with pwrite().
+void
+vectorio(char *s)
+{
+  struct iovec iov[3];
+  char a[10], b[3000], c[5], r[8];
+  int fd, i;
+
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  iov[0].iov_base = a; iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b; iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = c; iov[2].iov_len = sizeof(c);
+  fd = open("vecf", O_CREATE | O_RDWR);
+  if(fd < 0 || writev(fd, iov, 3) != 3015){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "xyz", 3, 1000) != 3 || pread(fd, r, 5, 999) != 5 ||
+     memcmp(r, "bxyzb", 5) != 0){
+    printf("%s: pwrite/pread failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vecf", O_RDONLY);
+  iov[0].iov_base = b; iov[0].iov_len = 2000;
+  iov[1].iov_base = buf; iov[1].iov_len = 2000;
+  if(readv(fd, iov, 2) != 3015){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3015; i++){
+    char want = i < 10 ? 'a' : i < 3010 ? 'b' : 'c';
+    if(i >= 1000 && i < 1003)
+      want = "xyz"[i - 1000];
+    if((i < 2000 ? b[i] : buf[i - 2000]) != want){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("vecf");
+}
+
+// grow a pipe so one write fits without a reader, then
+// splice its contents into a file and back.
+void
+pipesplice(char *s)
+{
+  enum { SZ = 8000 };
+  int fds[2], fd, i, n;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(pipesize(fds[1], 0) <= 0 || pipesize(fds[0], SZ) < SZ){
+    printf("%s: pipesize failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i * 7;
+  if(write(fds[1], buf, SZ) != SZ){
+    printf("%s: write to grown pipe failed\n", s);
+    exit(1);
+  }
+
+  fd = open("splicef", O_CREATE | O_RDWR);
+  if(fd < 0 || splice(fds[0], fd, SZ) != SZ){
+    printf("%s: splice pipe to file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("splicef", O_RDONLY);
+  if(fd < 0 || splice(fd, fds[1], SZ) != SZ){
+    printf("%s: splice file to pipe failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("splicef");
+
+  memset(buf, 0, SZ);
+  for(i = 0; i < SZ; i += n){
+    if((n = read(fds[0], buf + i, SZ - i)) <= 0){
+      printf("%s: read back failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < SZ; i++){
+    if(buf[i] != (char)(i * 7)){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
 
 // test if child is killed (status = -1)
 void
@@ -1781,6 +1885,515 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// group commit: many small ops in async log mode, then fsync().
+void
+asynclog(char *s)
+{
+  enum { N = 10, SZ = 100 };
+  int fd, i, old;
+  char name[8];
+
+  old = logmode(1);
+  if(old < 0){
+    printf("%s: logmode failed\n", s);
+    exit(1);
+  }
+  name[0] = 'a';
+  name[1] = 'l';
+  name[3] = '\0';
+  for(i = 0; i < N; i++){
+    name[2] = '0' + i;
+    fd = open(name, O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    memset(buf, i, SZ);
+    if(write(fd, buf, SZ) != SZ){
+      printf("%s: write %s failed\n", s, name);
+      exit(1);
+    }
+    if(i == N-1 && fsync(fd) != 0){
+      printf("%s: fsync failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < N; i++){
+    name[2] = '0' + i;
+    fd = open(name, O_RDONLY);
+    if(fd < 0 || read(fd, buf, SZ) != SZ || buf[0] != i || buf[SZ-1] != i){
+      printf("%s: read back %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    unlink(name);
+  }
+  logmode(old);
+}
+
+// write two files a block at a time, interleaved, so each
+// one needs more extents than fit in the inode and its first
+// extent block, then check both read back intact, in
+// order and backwards.
+void
+fragfile(char *s)
+{
+  enum { N = 300 };
+  int fd[2], i, j;
+
+  fd[0] = open("frag0", O_CREATE | O_RDWR);
+  fd[1] = open("frag1", O_CREATE | O_RDWR);
+  if(fd[0] < 0 || fd[1] < 0){
+    printf("%s: create frag failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    for(j = 0; j < 2; j++){
+      ((int*)buf)[0] = i;
+      ((int*)buf)[1] = j;
+      if(write(fd[j], buf, BSIZE) != BSIZE){
+        printf("%s: write frag%d failed i=%d\n", s, j, i);
+        exit(1);
+      }
+    }
+  }
+  close(fd[0]);
+  close(fd[1]);
+
+  for(j = 0; j < 2; j++){
+    fd[j] = open(j ? "frag1" : "frag0", O_RDONLY);
+    for(i = 0; i < N; i++){
+      if(read(fd[j], buf, BSIZE) != BSIZE ||
+         ((int*)buf)[0] != i || ((int*)buf)[1] != j){
+        printf("%s: read frag%d failed i=%d\n", s, j, i);
+        exit(1);
+      }
+    }
+    if(read(fd[j], buf, BSIZE) != 0){
+      printf("%s: frag%d too long\n", s, j);
+      exit(1);
+    }
+    // backwards, so each block is in a different extent
+    // than the one read before it.
+    for(i = N-1; i >= 0; i--){
+      if(pread(fd[j], buf, BSIZE, i*BSIZE) != BSIZE ||
+         ((int*)buf)[0] != i || ((int*)buf)[1] != j){
+        printf("%s: pread frag%d failed i=%d\n", s, j, i);
+        exit(1);
+      }
+    }
+    close(fd[j]);
+  }
+  unlink("frag0");
+  unlink("frag1");
+}
+
+// more files open at once than the NINODE entries the
+// in-memory inode table starts with. Each child keeps fds
+// 0-2, ready[1] and hold[0], so 5 + NF must fit in NOFILE.
+void
+manyinodes(char *s)
+{
+  enum { NCHILD = 6, NF = 10 };
+  int ready[2], hold[2], i, j, pid, fd;
+  char name[4], c;
+
+  if(pipe(ready) < 0 || pipe(hold) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(hold[1]);
+      name[0] = 'm';
+      name[1] = 'a' + i;
+      name[3] = 0;
+      for(j = 0; j < NF; j++){
+        name[2] = 'a' + j;
+        if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+          printf("%s: open %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(hold[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(hold[0]);
+  close(ready[1]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+  close(hold[1]);
+  close(ready[0]);
+  for(i = 0; i < NCHILD; i++){
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  name[0] = 'm';
+  name[3] = 0;
+  for(i = 0; i < NCHILD; i++){
+    name[1] = 'a' + i;
+    for(j = 0; j < NF; j++){
+      name[2] = 'a' + j;
+      unlink(name);
+    }
+  }
+}
+
+// small files live in the inode until they grow past it.
+void
+inlinefile(char *s)
+{
+  enum { N = 300 };
+  int fd, i, n;
+
+  for(i = 0; i < N; i++)
+    buf[i] = 'a' + i % 26;
+  fd = open("inl", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create inl failed\n", s);
+    exit(1);
+  }
+  // 100 bytes fit inline; the next 200 move them to a block.
+  if(write(fd, buf, 100) != 100 || write(fd, buf + 100, N - 100) != N - 100){
+    printf("%s: write inl failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inl", O_RDONLY);
+  n = read(fd, buf + N, N + 1);
+  close(fd);
+  if(n != N || memcmp(buf, buf + N, N) != 0){
+    printf("%s: read back %d bytes, wrong\n", s, n);
+    exit(1);
+  }
+
+  // truncation makes it inline again.
+  fd = open("inl", O_TRUNC | O_RDWR);
+  if(write(fd, "xyz", 3) != 3){
+    printf("%s: rewrite inl failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inl", O_RDONLY);
+  n = read(fd, buf + N, N);
+  close(fd);
+  if(n != 3 || memcmp(buf + N, "xyz", 3) != 0){
+    printf("%s: read after trunc failed\n", s);
+    exit(1);
+  }
+  unlink("inl");
+}
+
+// exec loads pages on first use, also when the first use is
+// the kernel copying to or from them.
+char lazydata[2*4096] = { 'l', 'a', 'z', 'y' };
+
+void
+lazyexec(char *s)
+{
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // from a .data page nobody has touched, into a pipe
+  if(write(fds[1], lazydata, 4) != 4){
+    printf("%s: write from .data failed\n", s);
+    exit(1);
+  }
+  // and into the second one, from the pipe
+  if(read(fds[0], lazydata + 4096, 4) != 4 || memcmp(lazydata + 4096, "lazy", 4) != 0){
+    printf("%s: read into .data failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// the file of a program being run (this one) cannot be
+// opened for writing or truncated, only read.
+void
+txtbusy(char *s)
+{
+  int fd;
+
+  if(open("/usertests", O_WRONLY) >= 0 || open("/usertests", O_RDWR) >= 0 ||
+     open("/usertests", O_RDONLY | O_TRUNC) >= 0){
+    printf("%s: opened running program for writing\n", s);
+    exit(1);
+  }
+  if((fd = open("/usertests", O_RDONLY)) < 0){
+    printf("%s: open running program failed\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+// spawn() a program with its stdout on a pipe.
+void
+spawntest(char *s)
+{
+  char *args[] = { "echo", "spawned", 0 };
+  int fds[2], map[3], pid, n, i, xstatus;
+  char out[16];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  map[0] = 0;
+  map[1] = fds[1];
+  map[2] = 2;
+  pid = spawn("echo", args, map, 3);
+  close(fds[1]);
+  if(pid < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  // echo writes its output in pieces
+  for(n = 0; n < sizeof(out) && (i = read(fds[0], out + n, sizeof(out) - n)) > 0; n += i)
+    ;
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if(n != 8 || memcmp(out, "spawned\n", 8) != 0){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+  if(spawn("nosuchprogram", args, map, 0) >= 0){
+    printf("%s: spawn of a missing program succeeded\n", s);
+    exit(1);
+  }
+}
+
+// a kernel printf() shows up in dmesg().
+void
+dmesgtest(char *s)
+{
+  static char buf[4096];
+  char *msg = "page fault va=0x3000000000";
+  int pid, n, i, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile char*)0x3000000000L = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child survived a bad store\n", s);
+    exit(1);
+  }
+  n = dmesg(buf, sizeof(buf));
+  if(n <= 0 || n > sizeof(buf)){
+    printf("%s: dmesg returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i + strlen(msg) <= n; i++)
+    if(memcmp(buf + i, msg, strlen(msg)) == 0)
+      break;
+  if(i + strlen(msg) > n){
+    printf("%s: kernel message missing from dmesg\n", s);
+    exit(1);
+  }
+  if(dmesg(buf, -1) >= 0){
+    printf("%s: dmesg with negative size succeeded\n", s);
+    exit(1);
+  }
+}
+
+// poll() on pipes: timeouts, data, a writer that shows up
+// later, and hang-up.
+void
+polltest(char *s)
+{
+  struct pollfd pf[2];
+  int fds[2], pid, n, t0;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pf[0].fd = fds[0];
+  pf[0].events = POLLIN;
+  pf[1].fd = fds[1];
+  pf[1].events = POLLOUT;
+  if(poll(pf, 2, 0) != 1 || pf[0].revents != 0 || pf[1].revents != POLLOUT){
+    printf("%s: empty pipe not reported as writable only\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  if(poll(pf, 1, 2) != 0 || uptime() - t0 < 1){
+    printf("%s: poll did not time out\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    sleep(2);
+    write(fds[1], "x", 1);
+    exit(0);
+  }
+  close(fds[1]);
+  if((n = poll(pf, 1, -1)) != 1 || (pf[0].revents & POLLIN) == 0){
+    printf("%s: poll for a late writer returned %d\n", s, n);
+    exit(1);
+  }
+  if(read(fds[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: read after poll failed\n", s);
+    exit(1);
+  }
+  wait(0);
+  if(poll(pf, 1, -1) != 1 || pf[0].revents != POLLHUP){
+    printf("%s: closed pipe not reported as hung up\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  pf[0].fd = fds[0];
+  if(poll(pf, 1, 0) != 1 || pf[0].revents != POLLNVAL){
+    printf("%s: closed fd not reported\n", s);
+    exit(1);
+  }
+}
+
+// the read-only pages with ticks and the pid agree with the
+// system calls, and cannot be written.
+void
+vdsotest(char *s)
+{
+  uint t0, t1, t2;
+  int pid, xstatus;
+
+  if(vdso_getpid() != getpid()){
+    printf("%s: vdso pid %d, getpid %d\n", s, vdso_getpid(), getpid());
+    exit(1);
+  }
+  t0 = uptime();
+  t1 = vdso_ticks();
+  t2 = uptime();
+  if(t1 < t0 || t1 > t2){
+    printf("%s: vdso ticks %d not within %d..%d\n", s, t1, t0, t2);
+    exit(1);
+  }
+  if(vdso_timefreq() == 0 || vdso_cpu() < 0 || vdso_cpu() >= NCPU){
+    printf("%s: bad vdso contents\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(vdso_getpid() != getpid())
+      exit(1);
+    *(volatile uint*)VDSO = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child could write the vdso page (%d)\n", s, xstatus);
+    exit(1);
+  }
+}
+
+// a batch of open/fstat/read/close through the ring runs in
+// order in one ring_enter(), and a failed open fails the rest.
+void
+ringtest(char *s)
+{
+  struct ring *r;
+  struct stat st;
+  char buf[16];
+  int fd, i, pid, xstatus, res[8];
+
+  unlink("ringf");
+  fd = open("ringf", O_CREATE | O_WRONLY);
+  if(fd < 0 || write(fd, "batched", 7) != 7){
+    printf("%s: create ringf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  r = ring_setup();
+  if(r == (struct ring*)-1 || ring_setup() != r){
+    printf("%s: ring_setup failed\n", s);
+    exit(1);
+  }
+  ring_push(r, RING_OPEN, 0, 0, "ringf", O_RDONLY, 0);
+  ring_push(r, RING_FSTAT, RING_LASTFD, 0, &st, 0, 1);
+  ring_push(r, RING_READ, RING_LASTFD, 0, buf, sizeof(buf), 2);
+  ring_push(r, RING_CLOSE, RING_LASTFD, 0, 0, 0, 3);
+  ring_push(r, RING_OPEN, 0, 0, "nosuchfile", O_RDONLY, 4);
+  ring_push(r, RING_READ, RING_LASTFD, 0, buf, sizeof(buf), 5);
+  ring_push(r, 99, 0, 0, 0, 0, 6);
+  ring_push(r, RING_NOP, 0, 0, 0, 0, 7);
+  if(ring_enter() != 8 || r->cq_tail - r->cq_head != 8){
+    printf("%s: ring_enter did not run the batch\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 8; i++, r->cq_head++){
+    if(r->cq[r->cq_head % RING_ENTRIES].data != i){
+      printf("%s: completions out of order\n", s);
+      exit(1);
+    }
+    res[i] = r->cq[r->cq_head % RING_ENTRIES].res;
+  }
+  if(res[0] < 0 || res[1] != 0 || st.size != 7 || res[2] != 7 ||
+     memcmp(buf, "batched", 7) != 0 || res[3] != 0){
+    printf("%s: wrong results for ringf\n", s);
+    exit(1);
+  }
+  if(res[4] >= 0 || res[5] >= 0 || res[6] >= 0 || res[7] != 0){
+    printf("%s: failures not reported\n", s);
+    exit(1);
+  }
+
+  // a child starts without a ring.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(ring_enter() == -1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child inherited the ring\n", s);
+    exit(1);
+  }
+  unlink("ringf");
+}
+
 void
 fourteen(char *s)
 {
@@ -2609,6 +3222,8 @@ struct test {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
+  {pipesplice, "pipesplice"},
+  {vectorio, "vectorio"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
@@ -2628,6 +3243,17 @@ struct test {
   {subdir, "subdir"},
   {bigwrite, "bigwrite"},
   {bigfile, "bigfile"},
+  {asynclog, "asynclog"},
+  {fragfile, "fragfile"},
+  {manyinodes, "manyinodes"},
+  {inlinefile, "inlinefile"},
+  {lazyexec, "lazyexec"},
+  {txtbusy, "txtbusy"},
+  {spawntest, "spawntest"},
+  {dmesgtest, "dmesgtest"},
+  {polltest, "polltest"},
+  {vdsotest, "vdsotest"},
+  {ringtest, "ringtest"},
   {fourteen, "fourteen"},
   {rmdot, "rmdot"},
   {dirfile, "dirfile"},
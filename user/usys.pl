@@ -45,4 +45,19 @@ entry("nice");
 entry("setscheduler");
 entry("term_raw");
 entry("term_cooked");
-entry("term_available");
\ No newline at end of file
+entry("term_available");
+entry("fsync");
+entry("logmode");
+entry("pipesize");
+entry("splice");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("fsstat");
+entry("spawn");
+entry("dmesg");
+entry("term_timeout");
+entry("poll");
+entry("ring_setup");
+entry("ring_enter");
\ No newline at end of file